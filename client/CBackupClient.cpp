@@ -0,0 +1,806 @@
+/**
+   Maman 14
+   @CBackupClient asynchronous client library. Requests are pipelined over a pool of persistent connections.
+   @author Roman Koifman
+ */
+
+#include "CBackupClient.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+
+using boost::asio::ip::tcp;
+
+
+/**
+   @brief start the connections' threads. Connecting is deferred until the first request is sent on a connection.
+   @param host server address.
+   @param port server port.
+   @param userId the user all requests are sent for.
+   @param connections connections pool size.
+   @param depth maximum requests per connection awaiting a response.
+ */
+CBackupClient::CBackupClient(const std::string& host, const uint16_t port, const uint32_t userId,
+	const size_t connections, const size_t depth) :
+	_host(host), _port(port), _userId(userId), _depth(std::max<size_t>(depth, 1)), _pending(0)
+{
+	for (size_t i = 0; i < std::max<size_t>(connections, 1); ++i)
+	{
+		_connections.push_back(std::make_unique<SConnection>());
+		SConnection& connection = *_connections.back();
+		connection.sender = std::thread(&CBackupClient::sendLoop, this, std::ref(connection));
+		connection.receiver = std::thread(&CBackupClient::receiveLoop, this, std::ref(connection));
+	}
+}
+
+
+/**
+   @brief wait for all submitted operations, then close the connections.
+ */
+CBackupClient::~CBackupClient()
+{
+	wait();
+	for (auto& connection : _connections)
+	{
+		{
+			std::lock_guard<std::mutex> guard(connection->mutex);
+			connection->stopping = true;
+		}
+		connection->changed.notify_all();
+		connection->sender.join();
+		connection->receiver.join();
+		boost::system::error_code error;
+		connection->sock.close(error);
+	}
+}
+
+
+/**
+   @brief block until all submitted operations completed.
+ */
+void CBackupClient::wait()
+{
+	std::unique_lock<std::mutex> guard(_pendingMutex);
+	_pendingDone.wait(guard, [this]() { return (_pending == 0); });
+}
+
+
+/**
+   @brief queue an operation on the least loaded connection.
+ */
+void CBackupClient::submit(const TOperation& operation)
+{
+	{
+		std::lock_guard<std::mutex> guard(_pendingMutex);
+		++_pending;
+	}
+	SConnection* target = nullptr;
+	size_t targetLoad = std::numeric_limits<size_t>::max();
+	for (auto& connection : _connections)
+	{
+		std::lock_guard<std::mutex> guard(connection->mutex);
+		const size_t load = connection->queued.size() + connection->inflight.size();
+		if (load < targetLoad)
+		{
+			target = connection.get();
+			targetLoad = load;
+		}
+	}
+	{
+		std::lock_guard<std::mutex> guard(target->mutex);
+		target->queued.push_back(operation);
+	}
+	target->changed.notify_all();
+}
+
+
+/**
+   @brief invoke the operation's callback & mark it completed.
+ */
+void CBackupClient::complete(SOperation& operation)
+{
+	if (operation.source.is_open())
+		operation.source.close();
+	try
+	{
+		if (operation.callback)
+			operation.callback(operation.result);
+	}
+	catch (std::exception&)
+	{
+		// callback failures are the caller's concern.
+	}
+	{
+		std::lock_guard<std::mutex> guard(_pendingMutex);
+		--_pending;
+	}
+	_pendingDone.notify_all();
+}
+
+
+/**
+   @brief connection's sending thread. Sends queued requests without waiting for previous responses,
+          as long as less than depth requests await a response. Reconnects a broken connection.
+ */
+void CBackupClient::sendLoop(SConnection& connection)
+{
+	std::unique_lock<std::mutex> guard(connection.mutex);
+	for (;;)
+	{
+		connection.changed.wait(guard, [this, &connection]()
+		{
+			return (connection.stopping || (!connection.queued.empty() && connection.inflight.size() < _depth));
+		});
+		if (connection.queued.empty())
+			break;  // stopping.
+
+		if (!connection.connected || connection.broken)
+		{
+			// receiving thread fails the operations sent on the broken connection.
+			connection.changed.wait(guard, [&connection]() { return connection.inflight.empty(); });
+			guard.unlock();
+			std::string error;
+			const bool connected = connect(connection, error);
+			guard.lock();
+			connection.connected = connected;
+			connection.broken = false;
+			connection.error.clear();
+			if (!connected)
+			{
+				std::deque<TOperation> failed;
+				failed.swap(connection.queued);
+				guard.unlock();
+				for (auto& operation : failed)
+				{
+					operation->result.error = error;
+					complete(*operation);
+				}
+				guard.lock();
+				continue;
+			}
+		}
+
+		TOperation operation = connection.queued.front();
+		connection.queued.pop_front();
+		guard.unlock();
+		if (!prepare(*operation))
+		{
+			complete(*operation);
+			guard.lock();
+			continue;
+		}
+		guard.lock();
+		connection.inflight.push_back(operation);
+		connection.changed.notify_all();
+		guard.unlock();
+
+		std::string error;
+		const bool sent = send(connection, *operation, error);
+		guard.lock();
+		if (!sent && !connection.broken)
+		{
+			connection.broken = true;
+			connection.error = error;
+			boost::system::error_code ignored;
+			connection.sock.shutdown(tcp::socket::shutdown_both, ignored);  // wakes the receiving thread.
+		}
+	}
+}
+
+
+/**
+   @brief connection's receiving thread. Responses arrive in the order requests were sent.
+          Once the connection breaks, all operations in flight fail.
+ */
+void CBackupClient::receiveLoop(SConnection& connection)
+{
+	std::unique_lock<std::mutex> guard(connection.mutex);
+	for (;;)
+	{
+		connection.changed.wait(guard, [&connection]() { return (connection.stopping || !connection.inflight.empty()); });
+		if (connection.inflight.empty())
+			break;  // stopping.
+
+		TOperation operation = connection.inflight.front();
+		guard.unlock();
+		std::string error;
+		const bool received = receive(connection, *operation, error);
+		guard.lock();
+		if (received)
+		{
+			connection.inflight.pop_front();
+			connection.changed.notify_all();
+			guard.unlock();
+			complete(*operation);
+			guard.lock();
+			continue;
+		}
+
+		if (!connection.broken)
+		{
+			connection.broken = true;
+			connection.error = error;
+			boost::system::error_code ignored;
+			connection.sock.shutdown(tcp::socket::shutdown_both, ignored);  // fails the sending thread.
+		}
+		std::deque<TOperation> failed;
+		failed.swap(connection.inflight);
+		error = connection.error;
+		connection.changed.notify_all();
+		guard.unlock();
+		for (auto& op : failed)
+		{
+			op->result = SResult();
+			op->result.error = error;
+			complete(*op);
+		}
+		guard.lock();
+	}
+}
+
+
+/**
+   @brief (re)connect to the server.
+   @param connection the connection to connect. No operation may be in flight on it.
+   @param error failure description. applicable only if function returns false.
+   @return true if connected. false otherwise.
+ */
+bool CBackupClient::connect(SConnection& connection, std::string& error)
+{
+	try
+	{
+		boost::system::error_code ignored;
+		connection.sock.close(ignored);
+		tcp::resolver resolver(connection.context);
+		boost::asio::connect(connection.sock, resolver.resolve(_host, std::to_string(_port)));
+		connection.sock.set_option(tcp::no_delay(true));   // requests are small. do not wait to coalesce them.
+		return true;
+	}
+	catch (std::exception& e)
+	{
+		error = std::string("Failed connecting to ") + _host + ":" + std::to_string(_port) + ": " + e.what();
+		return false;
+	}
+}
+
+
+/**
+   @brief validate an operation & serialize its request's first packet. A backup's source file is opened.
+   @return true if operation can be sent. false otherwise, the reason is saved in operation's result.
+ */
+bool CBackupClient::prepare(SOperation& operation)
+{
+	SRequest request;
+	request.header.userId = _userId;
+	request.header.version = CLIENT_VERSION_SPARSE;
+	request.header.op = operation.op;
+	if (operation.op != SRequest::FILE_DIR)
+	{
+		request.nameLen = static_cast<uint16_t>(std::min<size_t>(operation.filename.size(), PACKET_SIZE));
+		const bool nameRequired = (operation.op != SRequest::FILE_RESTORE_ALL);   // FILE_RESTORE_ALL prefix is optional.
+		if ((nameRequired && operation.filename.empty()) || operation.filename.size() != request.nameLen || request.sizeWithoutPayload() > PACKET_SIZE)
+		{
+			operation.result.error = "Invalid filename '" + operation.filename + "'";
+			return false;
+		}
+	}
+
+	if (operation.op == SRequest::FILE_BACKUP)
+	{
+		std::error_code error;
+		const uintmax_t size = std::filesystem::file_size(operation.localPath, error);
+		if (error)
+		{
+			operation.result.error = "Failed reading " + operation.localPath + ": " + error.message();
+			return false;
+		}
+		if (size > std::numeric_limits<uint32_t>::max())
+		{
+			operation.result.error = "File too large " + operation.localPath;
+			return false;
+		}
+		operation.size = static_cast<uint32_t>(size);
+		operation.source.open(operation.localPath, std::ios::binary);
+		if (!operation.source.is_open())
+		{
+			operation.result.error = "Failed opening " + operation.localPath;
+			return false;
+		}
+		request.payload.size = operation.size;
+	}
+	else if (operation.op == SRequest::FILE_COPY || operation.op == SRequest::FILE_RENAME)
+	{
+		request.payload.size = static_cast<uint32_t>(operation.destination.size());
+		if (operation.destination.empty() || request.sizeWithoutPayload() + request.payload.size > PACKET_SIZE)
+		{
+			operation.result.error = "Invalid destination filename '" + operation.destination + "'";
+			return false;
+		}
+	}
+	else if (operation.selector != 0)
+	{
+		request.payload.size = sizeof(operation.selector);
+	}
+
+	uint8_t* ptr = operation.packet;
+	memcpy(ptr, &request.header, sizeof(request.header));
+	ptr += sizeof(request.header);
+	memcpy(ptr, &request.nameLen, sizeof(request.nameLen));
+	ptr += sizeof(request.nameLen);
+	memcpy(ptr, operation.filename.data(), request.nameLen);
+	ptr += request.nameLen;
+	memcpy(ptr, &request.payload.size, sizeof(request.payload.size));
+	ptr += sizeof(request.payload.size);
+	operation.bytes = std::min<uint32_t>(request.payload.size, PACKET_SIZE - request.sizeWithoutPayload());
+	if (operation.op == SRequest::FILE_BACKUP)
+	{
+		if (!operation.source.read(reinterpret_cast<char*>(ptr), operation.bytes))
+		{
+			operation.result.error = "Failed reading " + operation.localPath;
+			return false;
+		}
+	}
+	else if (operation.op == SRequest::FILE_COPY || operation.op == SRequest::FILE_RENAME)
+	{
+		memcpy(ptr, operation.destination.data(), operation.bytes);
+	}
+	else if (operation.bytes != 0)
+	{
+		memcpy(ptr, &operation.selector, sizeof(operation.selector));
+	}
+	return true;
+}
+
+
+/**
+   @brief send a prepared request. A backup's file is streamed from disk, several packets at a time.
+   @param error failure description. applicable only if function returns false.
+   @return true if sent. false if the connection can't be used anymore.
+ */
+bool CBackupClient::send(SConnection& connection, SOperation& operation, std::string& error)
+{
+	try
+	{
+		(void)boost::asio::write(connection.sock, boost::asio::buffer(operation.packet, PACKET_SIZE));
+		std::vector<uint8_t> chunk;
+		for (uint32_t bytes = operation.bytes; bytes < operation.size; )  // only a backup's payload exceeds the first packet.
+		{
+			const uint32_t length = std::min<uint32_t>(operation.size - bytes, PACKET_SIZE * CLIENT_IO_PACKETS);
+			chunk.assign(((length + PACKET_SIZE - 1) / PACKET_SIZE) * PACKET_SIZE, 0);
+			if (!operation.source.read(reinterpret_cast<char*>(chunk.data()), length))
+			{
+				error = "Failed reading " + operation.localPath;
+				return false;  // server expects the rest of the payload. The connection can't be used anymore.
+			}
+			(void)boost::asio::write(connection.sock, boost::asio::buffer(chunk));
+			bytes += length;
+		}
+		return true;
+	}
+	catch (boost::system::system_error& e)
+	{
+		error = std::string("Failed sending: ") + e.what();
+		return false;
+	}
+}
+
+
+/**
+   @brief receive a response. A restored file is streamed to disk, several packets at a time.
+   @param error failure description. applicable only if function returns false.
+   @return true if received. false if the connection can't be used anymore.
+ */
+bool CBackupClient::receive(SConnection& connection, SOperation& operation, std::string& error)
+{
+	try
+	{
+		uint8_t packet[PACKET_SIZE];
+		(void)boost::asio::read(connection.sock, boost::asio::buffer(packet, PACKET_SIZE));
+		SResponse response;
+		const uint8_t* ptr = packet + sizeof(response.version);
+		memcpy(&response.status, ptr, sizeof(response.status));
+		ptr += sizeof(response.status);
+		memcpy(&response.nameLen, ptr, sizeof(response.nameLen));
+		ptr += sizeof(response.nameLen) + response.nameLen;
+		if (response.sizeWithoutPayload() > PACKET_SIZE)
+		{
+			error = "Invalid response received";
+			return false;
+		}
+		memcpy(&response.payload.size, ptr, sizeof(response.payload.size));
+		ptr += sizeof(response.payload.size);
+		operation.result.status = response.status;
+		if (response.status == SResponse::SUCCESS_RESTORE_ALL)
+		{
+			operation.result.size = response.payload.size;
+			receiveArchive(connection, operation, ptr, PACKET_SIZE - response.sizeWithoutPayload());
+			return true;
+		}
+		const bool sparse = (response.status == SResponse::SUCCESS_RESTORE_SPARSE);
+		if (response.status != SResponse::SUCCESS_RESTORE && response.status != SResponse::SUCCESS_DIR && !sparse)
+			return true;  // single packet. size & payload are invalid.
+
+		operation.result.size = response.payload.size;
+		std::ofstream destination;
+		std::string listing;
+		if (response.status != SResponse::SUCCESS_DIR)
+		{
+			destination.open(operation.localPath, std::ios::binary | std::ios::trunc);
+			if (!destination.is_open())
+				operation.result.error = "Failed creating " + operation.localPath;
+		}
+
+		// sparse restore: the extent map is gathered first. The extents' data is then written at their offsets,
+		// leaving the gaps as holes.
+		std::vector<uint8_t> extentMap;
+		SExtentMap map = {};
+		std::vector<SExtent> extents;
+		size_t extent = 0;
+		uint32_t extentOffset = 0;
+		auto consumeSparse = [&](const uint8_t* data, uint32_t length)
+		{
+			while (length > 0 && destination.is_open())
+			{
+				const size_t needed = sizeof(map) + ((extentMap.size() < sizeof(map)) ? 0 : (map.count * sizeof(SExtent)));
+				if (extentMap.size() < needed)
+				{
+					const uint32_t chunk = static_cast<uint32_t>(std::min<size_t>(length, needed - extentMap.size()));
+					extentMap.insert(extentMap.end(), data, data + chunk);
+					data += chunk;
+					length -= chunk;
+					if (extentMap.size() == sizeof(map))
+						memcpy(&map, extentMap.data(), sizeof(map));
+					if (extentMap.size() != sizeof(map) + (map.count * sizeof(SExtent)))
+						continue;
+					extents.resize(map.count);
+					memcpy(extents.data(), extentMap.data() + sizeof(map), map.count * sizeof(SExtent));
+					for (const auto& e : extents)
+					{
+						if (e.offset > map.size || e.length > map.size - e.offset)
+						{
+							operation.result.error = "Invalid extent map received";
+							destination.close();
+						}
+					}
+					continue;
+				}
+				if (extent >= extents.size())
+					return;  // padding.
+				if (extentOffset == 0)
+					destination.seekp(extents[extent].offset);
+				const uint32_t chunk = std::min(length, extents[extent].length - extentOffset);
+				destination.write(reinterpret_cast<const char*>(data), chunk);
+				data += chunk;
+				length -= chunk;
+				extentOffset += chunk;
+				if (extentOffset == extents[extent].length)
+				{
+					++extent;
+					extentOffset = 0;
+				}
+			}
+		};
+		auto consume = [&](const uint8_t* data, const uint32_t length)
+		{
+			if (response.status == SResponse::SUCCESS_DIR)
+				listing.append(reinterpret_cast<const char*>(data), length);
+			else if (sparse)
+				consumeSparse(data, length);
+			else if (destination.is_open())
+				destination.write(reinterpret_cast<const char*>(data), length);
+		};
+
+		uint32_t bytes = std::min<uint32_t>(response.payload.size, PACKET_SIZE - response.sizeWithoutPayload());
+		consume(ptr, bytes);
+		std::vector<uint8_t> chunk;
+		while (bytes < response.payload.size)  // payload continues in further packets.
+		{
+			const uint32_t length = std::min<uint32_t>(response.payload.size - bytes, PACKET_SIZE * CLIENT_IO_PACKETS);
+			chunk.resize(((length + PACKET_SIZE - 1) / PACKET_SIZE) * PACKET_SIZE);
+			(void)boost::asio::read(connection.sock, boost::asio::buffer(chunk));
+			consume(chunk.data(), length);
+			bytes += length;
+		}
+
+		if (response.status == SResponse::SUCCESS_DIR)
+		{
+			size_t start = 0;
+			for (size_t end = listing.find('\n'); end != std::string::npos; end = listing.find('\n', start))
+			{
+				operation.result.files.push_back(listing.substr(start, end - start));
+				start = end + 1;
+			}
+		}
+		else if (destination.is_open())
+		{
+			destination.close();
+			if (destination.fail())
+				operation.result.error = "Failed writing " + operation.localPath;
+			else if (sparse)
+			{
+				std::error_code resizeError;   // trailing hole.
+				std::filesystem::resize_file(operation.localPath, map.size, resizeError);
+				if (resizeError)
+					operation.result.error = "Failed writing " + operation.localPath;
+				operation.result.size = map.size;
+			}
+		}
+		return true;
+	}
+	catch (boost::system::system_error& e)
+	{
+		error = std::string("Failed receiving: ") + e.what();
+		return false;
+	}
+}
+
+/**
+   @brief receive a FILE_RESTORE_ALL archive stream, writing each file into the operation's folder as it arrives.
+          The stream is read to its end even on local failures, keeping the connection in sync.
+          Packets are read no further than the stream is known to extend, as the next response may follow.
+   @param data the stream's start, within the response's first packet.
+   @param length data's length.
+   @throw boost::system::system_error upon receive failure.
+ */
+void CBackupClient::receiveArchive(SConnection& connection, SOperation& operation, const uint8_t* data, const uint32_t length)
+{
+	std::error_code folderError;
+	std::filesystem::create_directories(operation.localPath, folderError);
+	if (folderError)
+		operation.result.error = "Failed creating " + operation.localPath + ": " + folderError.message();
+
+	std::vector<uint8_t> header;   // entry being gathered: SArchiveEntry, filename, size.
+	SArchiveEntry entry = {};
+	std::string name;
+	uint32_t remaining = 0;        // file bytes still to come.
+	bool inData = false;
+	bool ended = false;
+	std::ofstream destination;
+	auto finish = [&]()
+	{
+		inData = false;
+		if (!destination.is_open())
+			return;
+		destination.close();
+		if (destination.fail())
+			operation.result.error = "Failed writing " + name;
+		else
+			operation.result.files.push_back(name);
+	};
+	auto start = [&]()
+	{
+		inData = true;
+		if (name.empty() || name == "." || name == ".." || name.find_first_of("/\\") != std::string::npos)
+			operation.result.error = "Invalid filename received '" + name + "'";
+		else if (!folderError)
+		{
+			const std::string path = (std::filesystem::path(operation.localPath) / name).string();
+			destination.open(path, std::ios::binary | std::ios::trunc);
+			if (!destination.is_open())
+				operation.result.error = "Failed creating " + path;
+		}
+		if (remaining == 0)
+			finish();
+	};
+	auto consume = [&](const uint8_t* ptr, uint32_t bytes)
+	{
+		while (bytes > 0 && !ended)
+		{
+			if (inData)
+			{
+				const uint32_t chunk = std::min(bytes, remaining);
+				if (destination.is_open())
+					destination.write(reinterpret_cast<const char*>(ptr), chunk);
+				ptr += chunk;
+				bytes -= chunk;
+				remaining -= chunk;
+				if (remaining == 0)
+					finish();
+				continue;
+			}
+			const size_t needed = sizeof(entry) + ((header.size() < sizeof(entry)) ? 0 : (entry.nameLen + sizeof(remaining)));
+			const uint32_t chunk = static_cast<uint32_t>(std::min<size_t>(bytes, needed - header.size()));
+			header.insert(header.end(), ptr, ptr + chunk);
+			ptr += chunk;
+			bytes -= chunk;
+			if (header.size() == sizeof(entry))
+			{
+				memcpy(&entry, header.data(), sizeof(entry));
+				ended = (entry.nameLen == 0);
+			}
+			else if (header.size() == sizeof(entry) + entry.nameLen + sizeof(remaining))
+			{
+				name.assign(reinterpret_cast<const char*>(header.data() + sizeof(entry)), entry.nameLen);
+				memcpy(&remaining, header.data() + sizeof(entry) + entry.nameLen, sizeof(remaining));
+				header.clear();
+				start();
+			}
+		}
+	};
+
+	consume(data, length);
+	std::vector<uint8_t> chunk;
+	while (!ended)
+	{
+		// the stream extends at least over the current file's rest & the next entry's nameLen.
+		const uint64_t known = inData ? (static_cast<uint64_t>(remaining) + sizeof(entry)) : 1;
+		const uint64_t packets = std::min<uint64_t>((known + PACKET_SIZE - 1) / PACKET_SIZE, CLIENT_IO_PACKETS);
+		chunk.resize(static_cast<size_t>(packets * PACKET_SIZE));
+		(void)boost::asio::read(connection.sock, boost::asio::buffer(chunk));
+		consume(chunk.data(), static_cast<uint32_t>(chunk.size()));
+	}
+}
+
+
+/**
+   @brief backup a local file. The file is streamed from disk when the request is sent.
+   @param localPath the file to backup.
+   @param filename the file's name on server.
+   @param callback invoked once the server responded, or the operation failed.
+ */
+void CBackupClient::backup(const std::string& localPath, const std::string& filename, TCallback callback)
+{
+	auto operation = std::make_shared<SOperation>();
+	operation->op = SRequest::FILE_BACKUP;
+	operation->filename = filename;
+	operation->localPath = localPath;
+	operation->callback = std::move(callback);
+	submit(operation);
+}
+
+/**
+   @brief restore a file to a local path. The file is streamed to disk as it is received.
+   @param filename the file's name on server.
+   @param localPath the restored file's path. Overwritten if exists.
+   @param version 0 for the current content. N for the Nth previous version.
+   @param callback invoked once the file was restored, or the operation failed.
+ */
+void CBackupClient::restore(const std::string& filename, const std::string& localPath, const uint32_t version, TCallback callback)
+{
+	auto operation = std::make_shared<SOperation>();
+	operation->op = SRequest::FILE_RESTORE;
+	operation->filename = filename;
+	operation->localPath = localPath;
+	operation->selector = version;
+	operation->callback = std::move(callback);
+	submit(operation);
+}
+
+/**
+   @brief remove a file and its versions from server.
+   @param filename the file's name on server.
+   @param callback invoked once the server responded, or the operation failed.
+ */
+void CBackupClient::remove(const std::string& filename, TCallback callback)
+{
+	auto operation = std::make_shared<SOperation>();
+	operation->op = SRequest::FILE_REMOVE;
+	operation->filename = filename;
+	operation->callback = std::move(callback);
+	submit(operation);
+}
+
+/**
+   @brief list the user's files. Result's files are valid upon success.
+   @param versions whether to list previous versions too, as "filename@N".
+   @param callback invoked once the server responded, or the operation failed.
+ */
+void CBackupClient::list(const bool versions, TCallback callback)
+{
+	auto operation = std::make_shared<SOperation>();
+	operation->op = SRequest::FILE_DIR;
+	operation->selector = versions ? 1 : 0;
+	operation->callback = std::move(callback);
+	submit(operation);
+}
+
+
+/**
+   @brief copy a file within the server. No file data is transferred.
+   @param source the file's name on server.
+   @param destination the copy's name on server. If exists, its content is kept as a version (when enabled).
+   @param callback invoked once the server responded, or the operation failed.
+ */
+void CBackupClient::copy(const std::string& source, const std::string& destination, TCallback callback)
+{
+	auto operation = std::make_shared<SOperation>();
+	operation->op = SRequest::FILE_COPY;
+	operation->filename = source;
+	operation->destination = destination;
+	operation->callback = std::move(callback);
+	submit(operation);
+}
+
+/**
+   @brief rename a file within the server. No file data is transferred. The source's versions are removed.
+   @param source the file's name on server.
+   @param destination the file's new name on server. If exists, its content is kept as a version (when enabled).
+   @param callback invoked once the server responded, or the operation failed.
+ */
+void CBackupClient::rename(const std::string& source, const std::string& destination, TCallback callback)
+{
+	auto operation = std::make_shared<SOperation>();
+	operation->op = SRequest::FILE_RENAME;
+	operation->filename = source;
+	operation->destination = destination;
+	operation->callback = std::move(callback);
+	submit(operation);
+}
+
+
+/**
+   @brief restore all files on server, or those whose name starts with prefix, into a local folder.
+          Files are received back to back as one stream, within a single request.
+   @param prefix file names filter. Empty for all files.
+   @param localFolder the folder to restore the files into. Created if does not exist. Existing files are overwritten.
+   @param callback invoked once all files were restored, or the operation failed. result's files lists the restored files.
+ */
+void CBackupClient::restoreAll(const std::string& prefix, const std::string& localFolder, TCallback callback)
+{
+	auto operation = std::make_shared<SOperation>();
+	operation->op = SRequest::FILE_RESTORE_ALL;
+	operation->filename = prefix;
+	operation->localPath = localFolder;
+	operation->callback = std::move(callback);
+	submit(operation);
+}
+
+std::future<CBackupClient::SResult> CBackupClient::backup(const std::string& localPath, const std::string& filename)
+{
+	auto promise = std::make_shared<std::promise<SResult>>();
+	auto future = promise->get_future();
+	backup(localPath, filename, [promise](const SResult& result) { promise->set_value(result); });
+	return future;
+}
+
+std::future<CBackupClient::SResult> CBackupClient::restore(const std::string& filename, const std::string& localPath, const uint32_t version)
+{
+	auto promise = std::make_shared<std::promise<SResult>>();
+	auto future = promise->get_future();
+	restore(filename, localPath, version, [promise](const SResult& result) { promise->set_value(result); });
+	return future;
+}
+
+std::future<CBackupClient::SResult> CBackupClient::remove(const std::string& filename)
+{
+	auto promise = std::make_shared<std::promise<SResult>>();
+	auto future = promise->get_future();
+	remove(filename, [promise](const SResult& result) { promise->set_value(result); });
+	return future;
+}
+
+std::future<CBackupClient::SResult> CBackupClient::list(const bool versions)
+{
+	auto promise = std::make_shared<std::promise<SResult>>();
+	auto future = promise->get_future();
+	list(versions, [promise](const SResult& result) { promise->set_value(result); });
+	return future;
+}
+
+std::future<CBackupClient::SResult> CBackupClient::copy(const std::string& source, const std::string& destination)
+{
+	auto promise = std::make_shared<std::promise<SResult>>();
+	auto future = promise->get_future();
+	copy(source, destination, [promise](const SResult& result) { promise->set_value(result); });
+	return future;
+}
+
+std::future<CBackupClient::SResult> CBackupClient::rename(const std::string& source, const std::string& destination)
+{
+	auto promise = std::make_shared<std::promise<SResult>>();
+	auto future = promise->get_future();
+	rename(source, destination, [promise](const SResult& result) { promise->set_value(result); });
+	return future;
+}
+
+std::future<CBackupClient::SResult> CBackupClient::restoreAll(const std::string& prefix, const std::string& localFolder)
+{
+	auto promise = std::make_shared<std::promise<SResult>>();
+	auto future = promise->get_future();
+	restoreAll(prefix, localFolder, [promise](const SResult& result) { promise->set_value(result); });
+	return future;
+}
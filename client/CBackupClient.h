@@ -0,0 +1,120 @@
+/**
+   Maman 14
+   @CBackupClient asynchronous client library. Requests are pipelined over a pool of persistent connections.
+   @author Roman Koifman
+ */
+
+#pragma once
+#include "../server/Protocol.h"
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio/ip/tcp.hpp>
+
+class CBackupClient
+{
+#define DEFAULT_CONNECTIONS     4
+#define DEFAULT_PIPELINE_DEPTH  64   // requests sent on a connection before their responses are received.
+#define CLIENT_IO_PACKETS       64   // packets sent / received by a single socket call while streaming a file.
+
+public:
+    struct SResult
+    {
+        uint16_t status;                  // response status. 0 if no response was received.
+        uint32_t size;                    // response payload size. e.g. restored file size, FILE_RESTORE_ALL files count.
+        std::string error;                // local failure description. e.g. connection lost, local file unreadable.
+        std::vector<std::string> files;   // FILE_DIR listing. FILE_RESTORE_ALL restored files.
+        SResult() : status(0), size(0) {}
+        bool succeeded() const { return (error.empty() && (status == SResponse::SUCCESS_RESTORE || status == SResponse::SUCCESS_RESTORE_SPARSE ||
+            status == SResponse::SUCCESS_RESTORE_ALL || status == SResponse::SUCCESS_DIR || status == SResponse::SUCCESS_BACKUP_DELETE)); }
+    };
+
+    // Completion callback. Invoked on a connection's thread, hence should return quickly.
+    typedef std::function<void(const SResult&)> TCallback;
+
+private:
+    struct SOperation
+    {
+        uint8_t     op;
+        std::string filename;    // name on server. FILE_RESTORE_ALL name prefix.
+        std::string localPath;   // FILE_BACKUP source, FILE_RESTORE destination, FILE_RESTORE_ALL destination folder.
+        std::string destination; // FILE_COPY / FILE_RENAME name on server.
+        uint32_t    selector;    // FILE_RESTORE version, FILE_DIR versions flag.
+        uint32_t    size;        // FILE_BACKUP payload size.
+        std::ifstream source;    // FILE_BACKUP file, streamed while sending.
+        uint8_t     packet[PACKET_SIZE];   // request's first packet.
+        uint32_t    bytes;       // payload bytes within the first packet.
+        TCallback   callback;
+        SResult     result;
+        SOperation() : op(0), selector(0), size(0), packet(), bytes(0) {}
+    };
+    typedef std::shared_ptr<SOperation> TOperation;
+
+    struct SConnection
+    {
+        boost::asio::io_context      context;
+        boost::asio::ip::tcp::socket sock;
+        std::mutex                   mutex;
+        std::condition_variable      changed;
+        std::deque<TOperation>       queued;     // waiting to be sent.
+        std::deque<TOperation>       inflight;   // sent. responses arrive in this order.
+        std::string                  error;      // why the connection broke.
+        bool                         connected;
+        bool                         broken;     // reconnect once the in flight operations failed.
+        bool                         stopping;
+        std::thread                  sender;
+        std::thread                  receiver;
+        SConnection() : sock(context), connected(false), broken(false), stopping(false) {}
+    };
+
+    std::string _host;
+    uint16_t    _port;
+    uint32_t    _userId;
+    size_t      _depth;
+    std::vector<std::unique_ptr<SConnection>> _connections;
+    std::mutex              _pendingMutex;
+    std::condition_variable _pendingDone;
+    size_t                  _pending;    // submitted, not completed yet.
+
+    void submit(const TOperation& operation);
+    void complete(SOperation& operation);
+    void sendLoop(SConnection& connection);
+    void receiveLoop(SConnection& connection);
+    bool connect(SConnection& connection, std::string& error);
+    bool prepare(SOperation& operation);
+    bool send(SConnection& connection, SOperation& operation, std::string& error);
+    bool receive(SConnection& connection, SOperation& operation, std::string& error);
+    void receiveArchive(SConnection& connection, SOperation& operation, const uint8_t* data, const uint32_t length);
+
+public:
+    CBackupClient(const std::string& host, const uint16_t port, const uint32_t userId,
+        const size_t connections = DEFAULT_CONNECTIONS, const size_t depth = DEFAULT_PIPELINE_DEPTH);
+    ~CBackupClient();
+    CBackupClient(const CBackupClient&) = delete;
+    CBackupClient& operator=(const CBackupClient&) = delete;
+
+    void backup(const std::string& localPath, const std::string& filename, TCallback callback);
+    void restore(const std::string& filename, const std::string& localPath, const uint32_t version, TCallback callback);
+    void remove(const std::string& filename, TCallback callback);
+    void list(const bool versions, TCallback callback);
+    void copy(const std::string& source, const std::string& destination, TCallback callback);
+    void rename(const std::string& source, const std::string& destination, TCallback callback);
+    void restoreAll(const std::string& prefix, const std::string& localFolder, TCallback callback);
+
+    std::future<SResult> backup(const std::string& localPath, const std::string& filename);
+    std::future<SResult> restore(const std::string& filename, const std::string& localPath, const uint32_t version = 0);
+    std::future<SResult> remove(const std::string& filename);
+    std::future<SResult> list(const bool versions = false);
+    std::future<SResult> copy(const std::string& source, const std::string& destination);
+    std::future<SResult> rename(const std::string& source, const std::string& destination);
+    std::future<SResult> restoreAll(const std::string& prefix, const std::string& localFolder);
+
+    void wait();
+};
@@ -0,0 +1,99 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                //
+// backup_agent.cpp : Maman 14 bulk backup agent, built on the CBackupClient library.                             //
+// @author Roman Koifman                                                                                          //
+//                                                                                                                //
+// Backs up the given files, or the regular files directly within the given folders, by their file names.         //
+// Requests are pipelined over a pool of persistent connections.                                                  //
+//                                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "CBackupClient.h"
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+static std::string usage(const std::string& program)
+{
+    return "Usage: " + program + " --user ID [--host H] [--port P] [--connections N] [--depth N] PATH...\n";
+}
+
+int main(int argc, char* argv[])
+{
+    std::string host = "127.0.0.1";
+    uint16_t port = 8080;
+    uint32_t userId = 0;
+    size_t connections = DEFAULT_CONNECTIONS;
+    size_t depth = DEFAULT_PIPELINE_DEPTH;
+    std::vector<std::filesystem::path> files;
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = (i + 1 < argc);
+            if (arg == "--host" && hasValue)
+                host = argv[++i];
+            else if (arg == "--port" && hasValue)
+                port = static_cast<uint16_t>(std::stoul(argv[++i]));
+            else if (arg == "--user" && hasValue)
+                userId = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if (arg == "--connections" && hasValue)
+                connections = std::stoul(argv[++i]);
+            else if (arg == "--depth" && hasValue)
+                depth = std::stoul(argv[++i]);
+            else if (arg.rfind("--", 0) == 0)
+                throw std::invalid_argument("Unknown option " + arg);
+            else if (std::filesystem::is_directory(arg))
+            {
+                for (const auto& entry : std::filesystem::directory_iterator(arg))
+                {
+                    if (entry.is_regular_file())
+                        files.push_back(entry.path());
+                }
+            }
+            else
+                files.push_back(arg);
+        }
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << e.what() << std::endl << usage(argv[0]);
+        return 1;
+    }
+    if (userId == 0 || files.empty())
+    {
+        std::cerr << usage(argv[0]);
+        return 1;
+    }
+
+    std::atomic<size_t> succeeded(0);
+    std::mutex outputMutex;
+    const auto start = std::chrono::steady_clock::now();
+    {
+        CBackupClient client(host, port, userId, connections, depth);
+        for (const auto& file : files)
+        {
+            const std::string path = file.string();
+            client.backup(path, file.filename().string(), [&, path](const CBackupClient::SResult& result)
+            {
+                if (result.succeeded())
+                {
+                    ++succeeded;
+                    return;
+                }
+                std::lock_guard<std::mutex> guard(outputMutex);
+                std::cerr << path << ": " << (result.error.empty() ? "status " + std::to_string(result.status) : result.error) << std::endl;
+            });
+        }
+        client.wait();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << succeeded << "/" << files.size() << " files backed up in " << seconds << "s ("
+              << static_cast<uint64_t>(files.size() * 60 / std::max(seconds, 1e-6)) << " files/min)" << std::endl;
+    return (succeeded == files.size()) ? 0 : 1;
+}
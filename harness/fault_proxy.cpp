@@ -0,0 +1,298 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                //
+// fault_proxy.cpp : Maman 14 TCP proxy emulating slow & lossy client links, placed between clients and a server. //
+// @author Roman Koifman                                                                                          //
+//                                                                                                                //
+// Each direction of each connection is delayed (--delay-ms, --jitter-ms) and throttled (--bandwidth-kbps).       //
+// With --reset-permille, connections are reset (RST) after a random amount of forwarded bytes.                   //
+// Build with the same settings as the server. e.g.                                                               //
+// g++ -std=c++17 -O2 -o fault_proxy harness/fault_proxy.cpp -lpthread                                            //
+//                                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+using boost::asio::ip::tcp;
+typedef std::chrono::steady_clock TClock;
+
+#define PROXY_CHUNK_SIZE      16384   // bytes read from a socket at once.
+#define PROXY_THROTTLE_SLICE  1024    // throttled writes are split to this size, smoothing the rate.
+
+struct SOptions
+{
+    std::string listenPort = "9090";
+    std::string host = "127.0.0.1";    // server.
+    std::string port = "8080";
+    uint32_t delayMs = 0;              // one way delay, per direction.
+    uint32_t jitterMs = 0;             // random extra delay, up to this. Data is never reordered.
+    uint64_t bandwidthKbps = 0;        // per direction of each connection. 0 = unlimited.
+    uint32_t resetPermille = 0;        // connections reset, per 1000.
+    uint64_t resetMaxBytes = 1048576;  // a reset connection is reset after a uniformly random amount of bytes, up to this.
+};
+
+struct SChunk
+{
+    TClock::time_point due;            // when the chunk may be delivered.
+    std::vector<uint8_t> data;         // empty = end of stream.
+};
+
+// One direction of a connection: chunks read from one socket, waiting to be written to the other.
+struct SPipe
+{
+    std::mutex mutex;
+    std::condition_variable arrived;
+    std::deque<SChunk> chunks;
+};
+
+struct SLink
+{
+    tcp::socket client;
+    tcp::socket server;
+    std::atomic<bool> broken;          // reset or failed. All threads stop.
+    std::atomic<uint64_t> forwarded;   // bytes, both directions.
+    uint64_t resetAfter;               // forwarded bytes. 0 = never.
+    SPipe upstream;                    // client to server.
+    SPipe downstream;                  // server to client.
+    explicit SLink(boost::asio::io_context& context) : client(context), server(context), broken(false), forwarded(0), resetAfter(0) {}
+};
+
+
+/**
+   @brief stop a link's threads: blocked reads return (without notifying the peers), waiting writers wake up.
+ */
+static void breakLink(SLink& link)
+{
+    if (link.broken.exchange(true))
+        return;
+    boost::system::error_code ec;
+    link.client.shutdown(tcp::socket::shutdown_receive, ec);
+    link.server.shutdown(tcp::socket::shutdown_receive, ec);
+    for (SPipe* pipe : { &link.upstream, &link.downstream })
+    {
+        std::lock_guard<std::mutex> guard(pipe->mutex);
+        pipe->arrived.notify_all();
+    }
+}
+
+
+/**
+   @brief read from a socket into a pipe, stamping each chunk with its delivery time.
+ */
+static void readLoop(SLink& link, tcp::socket& from, SPipe& pipe, const SOptions& options, const uint32_t seed)
+{
+    std::minstd_rand random(seed);
+    TClock::time_point lastDue = TClock::now();
+    for (;;)
+    {
+        SChunk chunk;
+        chunk.data.resize(PROXY_CHUNK_SIZE);
+        boost::system::error_code ec;
+        const size_t bytes = from.read_some(boost::asio::buffer(chunk.data), ec);
+        chunk.data.resize(ec ? 0 : bytes);
+        uint32_t delayMs = options.delayMs;
+        if (options.jitterMs != 0)
+            delayMs += static_cast<uint32_t>(random() % (options.jitterMs + 1));
+        chunk.due = std::max(lastDue, TClock::now() + std::chrono::milliseconds(delayMs));   // keep the byte order.
+        lastDue = chunk.due;
+        const bool ended = chunk.data.empty();
+        {
+            std::lock_guard<std::mutex> guard(pipe.mutex);
+            pipe.chunks.push_back(std::move(chunk));
+        }
+        pipe.arrived.notify_one();
+        if (ended || link.broken)
+            return;
+    }
+}
+
+
+/**
+   @brief write a pipe's chunks to a socket once due, at no more than the configured bandwidth.
+          Resets the link once its forwarded bytes reach its reset point.
+ */
+static void writeLoop(SLink& link, tcp::socket& to, SPipe& pipe, const SOptions& options)
+{
+    const double bytesPerUs = static_cast<double>(options.bandwidthKbps) * 1000.0 / 8.0 / 1000000.0;
+    TClock::time_point free = TClock::now();   // when the throttled link is done with the previous bytes.
+    for (;;)
+    {
+        SChunk chunk;
+        {
+            std::unique_lock<std::mutex> lock(pipe.mutex);
+            pipe.arrived.wait(lock, [&]() { return !pipe.chunks.empty() || link.broken; });
+            if (link.broken)
+                return;
+            chunk = std::move(pipe.chunks.front());
+            pipe.chunks.pop_front();
+        }
+        if (chunk.data.empty())
+        {
+            boost::system::error_code ec;
+            to.shutdown(tcp::socket::shutdown_send, ec);   // forward the end of stream.
+            return;
+        }
+        std::this_thread::sleep_until(chunk.due);
+        size_t offset = 0;
+        while (offset < chunk.data.size() && !link.broken)
+        {
+            size_t length = chunk.data.size() - offset;
+            if (bytesPerUs > 0)
+            {
+                length = std::min<size_t>(length, PROXY_THROTTLE_SLICE);
+                free = std::max(free, TClock::now());
+                std::this_thread::sleep_until(free);
+                free += std::chrono::microseconds(static_cast<uint64_t>(static_cast<double>(length) / bytesPerUs));
+            }
+            if (link.resetAfter != 0)
+            {
+                const uint64_t forwarded = link.forwarded.load();
+                if (forwarded >= link.resetAfter)
+                {
+                    breakLink(link);
+                    return;
+                }
+                length = std::min<uint64_t>(length, link.resetAfter - forwarded);
+            }
+            boost::system::error_code ec;
+            boost::asio::write(to, boost::asio::buffer(chunk.data.data() + offset, length), ec);
+            if (ec)
+            {
+                breakLink(link);
+                return;
+            }
+            offset += length;
+            link.forwarded += length;
+        }
+    }
+}
+
+
+/**
+   @brief proxy a connection until both directions ended, or the link broke. A reset link is closed with RST.
+ */
+static void handleLink(std::shared_ptr<SLink> link, const tcp::resolver::results_type endpoints, const SOptions options, const uint32_t seed)
+{
+    boost::system::error_code ec;
+    boost::asio::connect(link->server, endpoints, ec);
+    if (!ec)
+    {
+        link->client.set_option(tcp::no_delay(true), ec);   // chunks are forwarded as they arrive. Delays are the proxy's alone.
+        link->server.set_option(tcp::no_delay(true), ec);
+        std::thread up([&]() { readLoop(*link, link->client, link->upstream, options, seed); });
+        std::thread down([&]() { readLoop(*link, link->server, link->downstream, options, seed + 1); });
+        std::thread upWriter([&]() { writeLoop(*link, link->server, link->upstream, options); });
+        std::thread downWriter([&]() { writeLoop(*link, link->client, link->downstream, options); });
+        upWriter.join();
+        downWriter.join();
+        breakLink(*link);   // unblock a reader whose peer never ended its stream.
+        up.join();
+        down.join();
+    }
+    if (link->resetAfter != 0 && link->forwarded >= link->resetAfter)
+    {
+        link->client.set_option(boost::asio::socket_base::linger(true, 0), ec);   // close sends RST.
+        link->server.set_option(boost::asio::socket_base::linger(true, 0), ec);
+        std::cerr << "Reset connection after " << link->forwarded << " bytes" << std::endl;
+    }
+    link->client.close(ec);
+    link->server.close(ec);
+}
+
+
+static bool parseOptions(const int argc, char* argv[], SOptions& options, std::stringstream& err)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string option(argv[i]);
+        if (i + 1 >= argc)
+        {
+            err << "Missing value for option " << option << std::endl;
+            return false;
+        }
+        const std::string value(argv[++i]);
+        try
+        {
+            if (option == "--listen")
+                options.listenPort = value;
+            else if (option == "--host")
+                options.host = value;
+            else if (option == "--port")
+                options.port = value;
+            else if (option == "--delay-ms")
+                options.delayMs = static_cast<uint32_t>(std::stoul(value));
+            else if (option == "--jitter-ms")
+                options.jitterMs = static_cast<uint32_t>(std::stoul(value));
+            else if (option == "--bandwidth-kbps")
+                options.bandwidthKbps = std::stoull(value);
+            else if (option == "--reset-permille")
+                options.resetPermille = static_cast<uint32_t>(std::stoul(value));
+            else if (option == "--reset-max-bytes")
+                options.resetMaxBytes = std::stoull(value);
+            else
+            {
+                err << "Unknown option: " << option << std::endl;
+                return false;
+            }
+        }
+        catch (std::exception&)
+        {
+            err << "Invalid value for option " << option << ": " << value << std::endl;
+            return false;
+        }
+    }
+    if (options.resetPermille > 1000 || options.resetMaxBytes == 0)
+    {
+        err << "Usage: " << argv[0] << " [--listen P] [--host H] [--port P] [--delay-ms N] [--jitter-ms N] [--bandwidth-kbps N]"
+            << " [--reset-permille N] [--reset-max-bytes N]" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    SOptions options;
+    std::stringstream err;
+    if (!parseOptions(argc, argv, options, err))
+    {
+        std::cerr << err.str();
+        return 1;
+    }
+
+    try
+    {
+        boost::asio::io_context io_context;
+        tcp::resolver resolver(io_context);
+        const auto endpoints = resolver.resolve(options.host, options.port);
+        tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), static_cast<uint16_t>(std::stoul(options.listenPort))));
+        std::mt19937 random(std::random_device{}());
+        std::cout << "Proxying port " << options.listenPort << " to " << options.host << ":" << options.port << std::endl;
+        for (;;)
+        {
+            auto link = std::make_shared<SLink>(io_context);
+            acceptor.accept(link->client);
+            if (options.resetPermille != 0 && (random() % 1000) < options.resetPermille)
+                link->resetAfter = 1 + (random() % options.resetMaxBytes);
+            std::thread(handleLink, link, endpoints, options, static_cast<uint32_t>(random())).detach();
+        }
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Exception: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,216 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                //
+// load.cpp : Maman 14 closed loop load generator, built on the CBackupClient library.                            //
+// @author Roman Koifman                                                                                          //
+//                                                                                                                //
+// Each user issues one request at a time for --duration seconds: a backup of --size bytes, or with probability   //
+// --restore-pct a restore of one of its backed up files. Reports throughput & latency percentiles per operation.  //
+// The last line is a machine readable summary, e.g. for harness/scenarios.sh.                                    //
+// Build with the same settings as the server. e.g.                                                               //
+// g++ -std=c++17 -O2 -o load harness/load.cpp client/CBackupClient.cpp -lpthread                                 //
+//                                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "../client/CBackupClient.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct SOptions
+{
+    std::string host = "127.0.0.1";
+    uint16_t port = 8080;
+    uint32_t users = 8;
+    uint32_t userBase = 1000;       // user IDs are userBase .. userBase + users - 1.
+    uint32_t duration = 10;         // seconds.
+    uint32_t size = 65536;          // backup size, bytes.
+    uint32_t restorePct = 20;       // requests restoring, per 100.
+    uint32_t files = 16;            // distinct file names per user.
+    std::string prefix = "load";    // file names prefix. Concurrent loads of the same users should differ.
+};
+
+struct SStats
+{
+    std::vector<uint64_t> latenciesUs;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+};
+
+
+static bool parseOptions(const int argc, char* argv[], SOptions& options, std::stringstream& err)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string option(argv[i]);
+        if (i + 1 >= argc)
+        {
+            err << "Missing value for option " << option << std::endl;
+            return false;
+        }
+        const std::string value(argv[++i]);
+        try
+        {
+            if (option == "--host")
+                options.host = value;
+            else if (option == "--port")
+                options.port = static_cast<uint16_t>(std::stoul(value));
+            else if (option == "--users")
+                options.users = static_cast<uint32_t>(std::stoul(value));
+            else if (option == "--user-base")
+                options.userBase = static_cast<uint32_t>(std::stoul(value));
+            else if (option == "--duration")
+                options.duration = static_cast<uint32_t>(std::stoul(value));
+            else if (option == "--size")
+                options.size = static_cast<uint32_t>(std::stoul(value));
+            else if (option == "--restore-pct")
+                options.restorePct = static_cast<uint32_t>(std::stoul(value));
+            else if (option == "--files")
+                options.files = static_cast<uint32_t>(std::stoul(value));
+            else if (option == "--prefix")
+                options.prefix = value;
+            else
+            {
+                err << "Unknown option: " << option << std::endl;
+                return false;
+            }
+        }
+        catch (std::exception&)
+        {
+            err << "Invalid value for option " << option << ": " << value << std::endl;
+            return false;
+        }
+    }
+    if (options.users == 0 || options.userBase == 0 || options.files == 0 || options.restorePct > 100)
+    {
+        err << "Usage: " << argv[0] << " [--host H] [--port P] [--users N] [--user-base ID] [--duration S] [--size BYTES]"
+            << " [--restore-pct P] [--files N] [--prefix NAME]" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+static uint64_t percentile(const std::vector<uint64_t>& sorted, const double p)
+{
+    if (sorted.empty())
+        return 0;
+    const size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size())));
+    return sorted[index];
+}
+
+
+int main(int argc, char* argv[])
+{
+    SOptions options;
+    std::stringstream err;
+    if (!parseOptions(argc, argv, options, err))
+    {
+        std::cerr << err.str();
+        return 1;
+    }
+
+    // local files: the backup source, and a restore destination per user.
+    const auto folder = std::filesystem::temp_directory_path() / (options.prefix + "-" + std::to_string(options.userBase) + "-load");
+    const std::string source = (folder / "source").string();
+    try
+    {
+        std::filesystem::create_directories(folder);
+        std::ofstream fs(source, std::ios::binary | std::ios::trunc);
+        std::mt19937 random(options.userBase);
+        std::vector<char> block(4096);
+        for (uint32_t written = 0; written < options.size; written += static_cast<uint32_t>(block.size()))
+        {
+            for (auto& c : block)
+                c = static_cast<char>(random());
+            fs.write(block.data(), std::min<uint32_t>(static_cast<uint32_t>(block.size()), options.size - written));
+        }
+        if (!fs)
+            throw std::runtime_error("Failed writing " + source);
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    enum { OP_BACKUP = 0, OP_RESTORE, OP_COUNT };
+    const char* const names[OP_COUNT] = { "backup", "restore" };
+    SStats stats[OP_COUNT];
+    std::mutex statsMutex;
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + std::chrono::seconds(options.duration);
+    std::vector<std::thread> users;
+    for (uint32_t u = 0; u < options.users; ++u)
+    {
+        users.emplace_back([&, u]()
+        {
+            const uint32_t userId = options.userBase + u;
+            const std::string destination = (folder / ("restore-" + std::to_string(userId))).string();
+            CBackupClient client(options.host, options.port, userId, 1, 1);
+            std::mt19937 random(userId);
+            uint32_t backedUp = 0;   // files 0 .. backedUp - 1 exist on server.
+            SStats local[OP_COUNT];
+            while (std::chrono::steady_clock::now() < end)
+            {
+                const bool restore = (backedUp != 0) && ((random() % 100) < options.restorePct);
+                const uint32_t file = restore ? (random() % backedUp) : std::min(backedUp, options.files - 1);
+                const std::string filename = options.prefix + std::to_string(file);
+                const auto requestStart = std::chrono::steady_clock::now();
+                const auto result = restore ? client.restore(filename, destination).get() : client.backup(source, filename).get();
+                SStats& op = local[restore ? OP_RESTORE : OP_BACKUP];
+                if (!result.succeeded())
+                {
+                    ++op.errors;
+                    continue;
+                }
+                op.latenciesUs.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - requestStart).count()));
+                op.bytes += options.size;
+                if (!restore && file == backedUp)
+                    ++backedUp;
+            }
+            std::lock_guard<std::mutex> guard(statsMutex);
+            for (int i = 0; i < OP_COUNT; ++i)
+            {
+                stats[i].latenciesUs.insert(stats[i].latenciesUs.end(), local[i].latenciesUs.begin(), local[i].latenciesUs.end());
+                stats[i].bytes += local[i].bytes;
+                stats[i].errors += local[i].errors;
+            }
+        });
+    }
+    for (auto& user : users)
+        user.join();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::error_code ec;
+    std::filesystem::remove_all(folder, ec);
+
+    // Report.
+    SStats all;
+    for (int i = 0; i < OP_COUNT; ++i)
+    {
+        std::sort(stats[i].latenciesUs.begin(), stats[i].latenciesUs.end());
+        std::cout << names[i] << ": " << stats[i].latenciesUs.size() << " ok, " << stats[i].errors << " failed, "
+            << (static_cast<double>(stats[i].latenciesUs.size()) / seconds) << " req/s, "
+            << (static_cast<double>(stats[i].bytes) / seconds / 1048576.0) << " MB/s, latency us: p50 "
+            << percentile(stats[i].latenciesUs, 0.50) << ", p99 " << percentile(stats[i].latenciesUs, 0.99)
+            << ", max " << (stats[i].latenciesUs.empty() ? 0 : stats[i].latenciesUs.back()) << std::endl;
+        all.latenciesUs.insert(all.latenciesUs.end(), stats[i].latenciesUs.begin(), stats[i].latenciesUs.end());
+        all.bytes += stats[i].bytes;
+        all.errors += stats[i].errors;
+    }
+    std::sort(all.latenciesUs.begin(), all.latenciesUs.end());
+    std::cout << "summary req_per_sec=" << (static_cast<double>(all.latenciesUs.size()) / seconds)
+        << " mb_per_sec=" << (static_cast<double>(all.bytes) / seconds / 1048576.0)
+        << " p50_us=" << percentile(all.latenciesUs, 0.50) << " p99_us=" << percentile(all.latenciesUs, 0.99)
+        << " errors=" << all.errors << std::endl;
+    return 0;
+}
@@ -0,0 +1,135 @@
+#!/bin/bash
+####################################################################################################################
+#                                                                                                                  #
+# scenarios.sh : Maman 14 fault injection scenarios. Runs the server under degraded disk & network conditions     #
+#                and reports how throughput and latency respond.                                                    #
+# @author Roman Koifman                                                                                            #
+#                                                                                                                  #
+# Usage: scenarios.sh [SCENARIO...]   (default: all)                                                               #
+# Binaries are taken from SERVER, LOAD & PROXY (default ./server, ./load, ./fault_proxy). DURATION sets seconds     #
+# per scenario (default 10). BUDGET_<scenario>=MS fails the run (exit 1) if the scenario's p99 exceeds MS, e.g.     #
+# BUDGET_head_of_line=200 catches a slow client blocking the requests of its user.                                 #
+#                                                                                                                  #
+####################################################################################################################
+
+SERVER=${SERVER:-./server}
+LOAD=${LOAD:-./load}
+PROXY=${PROXY:-./fault_proxy}
+DURATION=${DURATION:-10}
+PORT=${PORT:-18080}
+PROXY_PORT=$((PORT + 1))
+WORK=$(mktemp -d)
+PIDS=()
+FAILED=0
+
+cleanup()
+{
+    for pid in "${PIDS[@]}"; do kill "$pid" 2>/dev/null; done
+    wait 2>/dev/null
+    PIDS=()
+}
+trap 'cleanup; rm -rf "$WORK"' EXIT
+
+# start_server ARGS... : a server with a fresh backup folder.
+start_server()
+{
+    rm -rf "$WORK/root"
+    "$SERVER" --port "$PORT" --root "$WORK/root/" --log "$WORK/server.log" "$@" > "$WORK/server.out" 2>&1 &
+    PIDS+=($!)
+}
+
+# start_proxy ARGS... : a fault proxy in front of the server, on PROXY_PORT.
+start_proxy()
+{
+    "$PROXY" --listen "$PROXY_PORT" --port "$PORT" "$@" > /dev/null 2> "$WORK/proxy.log" &
+    PIDS+=($!)
+}
+
+# report NAME SUMMARY : print a summary line of load as a table row, and check the scenario's p99 budget.
+report()
+{
+    local name=$1 summary=$2
+    local rps mbps p50 p99 errors
+    rps=$(sed -n 's/.*req_per_sec=\([^ ]*\).*/\1/p' <<< "$summary")
+    mbps=$(sed -n 's/.*mb_per_sec=\([^ ]*\).*/\1/p' <<< "$summary")
+    p50=$(sed -n 's/.*p50_us=\([^ ]*\).*/\1/p' <<< "$summary")
+    p99=$(sed -n 's/.*p99_us=\([^ ]*\).*/\1/p' <<< "$summary")
+    errors=$(sed -n 's/.*errors=\([^ ]*\).*/\1/p' <<< "$summary")
+    if [ -z "$p99" ]; then
+        printf "%-14s %s\n" "$name" "no result"
+        FAILED=1
+        return
+    fi
+    awk -v n="$name" -v r="$rps" -v m="$mbps" -v p50="$p50" -v p99="$p99" -v e="$errors" \
+        'BEGIN { printf "%-14s %10.1f %10.2f %10.1f %10.1f %8s\n", n, r, m, p50 / 1000, p99 / 1000, e }'
+    local budget="BUDGET_$name"
+    if [ -n "${!budget}" ] && [ "$p99" -gt $((${!budget} * 1000)) ]; then
+        echo "  p99 exceeds budget of ${!budget} ms"
+        FAILED=1
+    fi
+}
+
+# run_load ARGS... : run load against the server (or proxy, by --port), print its summary line.
+run_load()
+{
+    "$LOAD" --duration "$DURATION" "$@" | tail -n 1
+}
+
+scenario()
+{
+    local name=$1
+    sleep 0.5   # let server & proxy start listening.
+    case "$name" in
+    baseline)
+        report "$name" "$(run_load --port "$PORT")";;
+    slow_disk)   # every file system call delayed 0.2 - 2.2 ms.
+        report "$name" "$(run_load --port "$PORT")";;
+    disk_errors) # 0.1% of file system calls (one per packet written) fail.
+        report "$name" "$(run_load --port "$PORT")";;
+    slow_link)   # 20 ms one way, 10 Mbps per connection.
+        report "$name" "$(run_load --port "$PROXY_PORT")";;
+    lossy_link)  # 10% of connections reset within their first MiB.
+        report "$name" "$(run_load --port "$PROXY_PORT")";;
+    head_of_line)
+        # slow clients trickle 256 KiB backups at 512 Kbps, while fast clients of the same users work directly.
+        # reported latency is the fast clients'.
+        run_load --port "$PROXY_PORT" --users 2 --user-base 5000 --size 262144 --restore-pct 0 --prefix slow > /dev/null &
+        local slow=$!
+        report "$name" "$(run_load --port "$PORT" --users 2 --user-base 5000 --prefix fast)"
+        wait $slow;;
+    esac
+}
+
+setup()
+{
+    case "$1" in
+    baseline|head_of_line) start_server;;
+    slow_disk) start_server --fault-disk-latency-us 200 --fault-disk-jitter-us 2000;;
+    disk_errors) start_server --fault-disk-error-permille 1;;
+    slow_link) start_server; start_proxy --delay-ms 20 --bandwidth-kbps 10000;;
+    lossy_link) start_server; start_proxy --reset-permille 100;;
+    *) echo "Unknown scenario: $1"; exit 2;;
+    esac
+    if [ "$1" = "head_of_line" ]; then
+        start_proxy --bandwidth-kbps 512
+    fi
+}
+
+SCENARIOS=("$@")
+if [ ${#SCENARIOS[@]} -eq 0 ]; then
+    SCENARIOS=(baseline slow_disk disk_errors slow_link lossy_link head_of_line)
+fi
+for binary in "$SERVER" "$LOAD" "$PROXY"; do
+    if [ ! -x "$binary" ]; then
+        echo "Missing binary $binary (see the build lines atop harness/*.cpp)"
+        exit 2
+    fi
+done
+
+printf "%-14s %10s %10s %10s %10s %8s\n" "scenario" "req/s" "MB/s" "p50 ms" "p99 ms" "errors"
+for name in "${SCENARIOS[@]}"; do
+    setup "$name"
+    scenario "$name"
+    cleanup
+done
+exit $FAILED
@@ -0,0 +1,397 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                //
+// replay.cpp : Re-issue a requests trace recorded by the server (--trace) against a server.                      //
+// @author Roman Koifman                                                                                          //
+//                                                                                                                //
+// Requests are issued at their recorded offsets (scaled by --speed), or as fast as possible (--afap).            //
+// FILE_BACKUP payloads are synthetic, of the recorded size. Control payloads (version selectors, FILE_DIR flags, //
+// destination filenames) are replayed as recorded. Requests of the same user complete in their recorded order.   //
+// Build with the same settings as the server, adding server/CSocketHandler.cpp & server/CTraceRecorder.cpp.      //
+//                                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "../server/CSocketHandler.h"
+#include "../server/Protocol.h"
+#include "../server/CTraceRecorder.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+using boost::asio::ip::tcp;
+
+struct SEntry
+{
+    CTraceRecorder::SRecord record;
+    std::string filename;
+    std::string control;       // recorded control payload. Empty for FILE_BACKUP & traces without TRACE_FLAG_CONTROL.
+    uint16_t status = 0;       // recorded response status. 0 if no response, or a trace without TRACE_FLAG_STATUS.
+    uint64_t payloadHash = 0;
+};
+
+struct SOptions
+{
+    std::string trace;
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    double speed = 1.0;        // offsets are divided by speed.
+    bool afap = false;         // ignore offsets.
+    uint32_t connections = 64; // concurrent requests.
+};
+
+struct SResult
+{
+    uint16_t status = 0;       // 0 if no response.
+    uint64_t latencyUs = 0;
+    uint64_t lateUs = 0;       // how late the request was issued relative to its scaled offset.
+};
+
+
+/**
+   @brief load a trace file, sorted by offset.
+ */
+static bool loadTrace(const std::string& filepath, std::vector<SEntry>& entries, std::stringstream& err)
+{
+    std::ifstream fs(filepath, std::ifstream::binary);
+    if (!fs.is_open())
+    {
+        err << "Failed to open trace " << filepath << std::endl;
+        return false;
+    }
+    CTraceRecorder::SFileHeader header;
+    if (!fs.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0)
+    {
+        err << "Invalid trace file " << filepath << std::endl;
+        return false;
+    }
+    SEntry entry;
+    while (fs.read(reinterpret_cast<char*>(&entry.record), sizeof(entry.record)))
+    {
+        entry.filename.assign(entry.record.nameLen, '\0');
+        if (entry.record.nameLen != 0 && !fs.read(&entry.filename[0], entry.record.nameLen))
+            break;
+        uint16_t controlLen = 0;
+        if ((header.flags & TRACE_FLAG_CONTROL) && !fs.read(reinterpret_cast<char*>(&controlLen), sizeof(controlLen)))
+            break;
+        entry.control.assign(controlLen, '\0');
+        if (controlLen != 0 && !fs.read(&entry.control[0], controlLen))
+            break;
+        entry.status = 0;
+        if ((header.flags & TRACE_FLAG_STATUS) && !fs.read(reinterpret_cast<char*>(&entry.status), sizeof(entry.status)))
+            break;
+        if ((header.flags & TRACE_FLAG_HASHES) && !fs.read(reinterpret_cast<char*>(&entry.payloadHash), sizeof(entry.payloadHash)))
+            break;
+        entries.push_back(entry);
+    }
+    std::stable_sort(entries.begin(), entries.end(), [](const SEntry& a, const SEntry& b)
+    {
+        return a.record.offsetUs < b.record.offsetUs;
+    });
+    return true;
+}
+
+
+/**
+   @brief fill a buffer with synthetic payload bytes. Deterministic given the seed & position.
+ */
+static void synthesize(uint64_t& state, uint8_t* buffer, const uint32_t size)
+{
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        buffer[i] = static_cast<uint8_t>(state);
+    }
+}
+
+
+/**
+   @brief issue a single request and consume its response.
+   @return true if a response was received.
+ */
+static bool issue(const SEntry& entry, const tcp::resolver::results_type& endpoints, SResult& result)
+{
+    CSocketHandler socketHandler;
+    uint8_t buffer[PACKET_SIZE] = { 0 };
+    const auto& record = entry.record;
+    SRequest::SRequestHeader header;
+    header.userId = record.userId;
+    header.version = record.version;
+    header.op = record.op;
+    const uint32_t withoutPayload = sizeof(header) + sizeof(record.nameLen) + record.nameLen + sizeof(record.payloadSize);
+    if (withoutPayload > PACKET_SIZE)
+        return false;
+
+    try
+    {
+        boost::asio::io_context io_context;
+        tcp::socket sock(io_context);
+        boost::asio::connect(sock, endpoints);
+        const auto start = std::chrono::steady_clock::now();
+
+        uint8_t* ptr = buffer;
+        memcpy(ptr, &header, sizeof(header));
+        ptr += sizeof(header);
+        memcpy(ptr, &record.nameLen, sizeof(record.nameLen));
+        ptr += sizeof(record.nameLen);
+        memcpy(ptr, entry.filename.data(), record.nameLen);
+        ptr += record.nameLen;
+        memcpy(ptr, &record.payloadSize, sizeof(record.payloadSize));
+        ptr += sizeof(record.payloadSize);
+
+        uint64_t state = (static_cast<uint64_t>(record.userId) << 32) ^ record.payloadSize ^ entry.payloadHash ^ 0x9E3779B97F4A7C15ULL;
+        uint32_t bytes = std::min(PACKET_SIZE - withoutPayload, record.payloadSize);
+        synthesize(state, ptr, bytes);
+        if (!entry.control.empty())
+            memcpy(ptr, entry.control.data(), std::min<size_t>(entry.control.size(), bytes));   // replayed as recorded.
+        else if (record.op == SRequest::FILE_COPY || record.op == SRequest::FILE_RENAME)   // trace without control payloads.
+        {
+            const char charset[] = "0123456789abcdefghijklmnopqrstuvwxyz";   // payload is a destination filename.
+            for (uint32_t i = 0; i < bytes; ++i)
+                ptr[i] = static_cast<uint8_t>(charset[ptr[i] % (sizeof(charset) - 1)]);
+        }
+        if (!socketHandler.send(sock, buffer))
+            return false;
+        while (bytes < record.payloadSize)
+        {
+            const uint32_t length = std::min<uint32_t>(PACKET_SIZE, record.payloadSize - bytes);
+            memset(buffer, 0, PACKET_SIZE);
+            synthesize(state, buffer, length);
+            if (!socketHandler.send(sock, buffer))
+                return false;
+            bytes += length;
+        }
+
+        // response: version(1), status(2), nameLen(2), filename, payload size(4), payload.
+        if (!socketHandler.receive(sock, buffer))
+            return false;
+        uint16_t nameLen = 0;
+        uint32_t payloadSize = 0;
+        memcpy(&result.status, buffer + 1, sizeof(result.status));
+        memcpy(&nameLen, buffer + 3, sizeof(nameLen));
+        const uint32_t responseWithoutPayload = 1 + sizeof(result.status) + sizeof(nameLen) + nameLen + sizeof(payloadSize);
+        if (responseWithoutPayload <= PACKET_SIZE &&
+            (result.status == SResponse::SUCCESS_RESTORE || result.status == SResponse::SUCCESS_RESTORE_SPARSE ||
+             result.status == SResponse::SUCCESS_DIR))
+        {
+            memcpy(&payloadSize, buffer + 5 + nameLen, sizeof(payloadSize));
+            uint32_t received = std::min(PACKET_SIZE - responseWithoutPayload, payloadSize);
+            while (received < payloadSize && socketHandler.receive(sock, buffer))
+                received += PACKET_SIZE;
+        }
+        else if (responseWithoutPayload <= PACKET_SIZE && result.status == SResponse::SUCCESS_RESTORE_ALL)
+        {
+            // archive stream: entries of nameLen, filename, size & data until nameLen 0. buffer holds [received - PACKET_SIZE, received).
+            uint64_t position = responseWithoutPayload;
+            uint64_t received = PACKET_SIZE;
+            auto field = [&](uint8_t* out, const uint32_t length) -> bool
+            {
+                for (uint32_t i = 0; i < length; ++i, ++position)
+                {
+                    for (; position >= received; received += PACKET_SIZE)
+                    {
+                        if (!socketHandler.receive(sock, buffer))
+                            return false;
+                    }
+                    out[i] = buffer[position + PACKET_SIZE - received];
+                }
+                return true;
+            };
+            SArchiveEntry entry;
+            uint32_t size = 0;
+            while (field(reinterpret_cast<uint8_t*>(&entry), sizeof(entry)) && entry.nameLen != 0)
+            {
+                position += entry.nameLen;
+                if (!field(reinterpret_cast<uint8_t*>(&size), sizeof(size)))
+                    break;
+                position += size;
+            }
+        }
+        result.latencyUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        boost::system::error_code ec;
+        sock.close(ec);
+        return true;
+    }
+    catch (std::exception&)
+    {
+        return false;
+    }
+}
+
+
+static bool parseOptions(const int argc, char* argv[], SOptions& options, std::stringstream& err)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string option(argv[i]);
+        if (option == "--afap")
+        {
+            options.afap = true;
+            continue;
+        }
+        if (option.rfind("--", 0) != 0)
+        {
+            options.trace = option;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            err << "Missing value for option " << option << std::endl;
+            return false;
+        }
+        const std::string value(argv[++i]);
+        try
+        {
+            if (option == "--host")
+                options.host = value;
+            else if (option == "--port")
+                options.port = value;
+            else if (option == "--speed")
+                options.speed = std::stod(value);
+            else if (option == "--connections")
+                options.connections = static_cast<uint32_t>(std::stoul(value));
+            else
+            {
+                err << "Unknown option: " << option << std::endl;
+                return false;
+            }
+        }
+        catch (std::exception&)
+        {
+            err << "Invalid value for option " << option << ": " << value << std::endl;
+            return false;
+        }
+    }
+    if (options.trace.empty() || options.speed <= 0 || options.connections == 0)
+    {
+        err << "Usage: " << argv[0] << " TRACE [--host H] [--port P] [--speed X | --afap] [--connections N]" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+static uint64_t percentile(const std::vector<uint64_t>& sorted, const double p)
+{
+    if (sorted.empty())
+        return 0;
+    const size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size())));
+    return sorted[index];
+}
+
+
+int main(int argc, char* argv[])
+{
+    SOptions options;
+    std::stringstream err;
+    std::vector<SEntry> entries;
+    if (!parseOptions(argc, argv, options, err) || !loadTrace(options.trace, entries, err))
+    {
+        std::cerr << err.str();
+        return 1;
+    }
+
+    try
+    {
+        boost::asio::io_context io_context;
+        tcp::resolver resolver(io_context);
+        const auto endpoints = resolver.resolve(options.host, options.port);
+
+        // Requests are issued in offset order. Requests of the same user also complete in that order: the server
+        // serializes them anyway, and e.g. a restore must follow the backup it depends on.
+        struct SUserOrder
+        {
+            std::mutex mutex;
+            std::condition_variable turn;
+            size_t done = 0;      // requests of this user completed so far.
+        };
+        std::map<uint32_t, SUserOrder> users;
+        std::vector<size_t> sequence(entries.size());   // request's position within its user's requests.
+        std::map<uint32_t, size_t> counts;
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            sequence[i] = counts[entries[i].record.userId]++;
+            (void)users[entries[i].record.userId];
+        }
+
+        std::vector<SResult> results(entries.size());
+        std::vector<uint8_t> failed(entries.size(), 0);
+        std::atomic<size_t> next(0);
+        const auto start = std::chrono::steady_clock::now();
+        auto worker = [&]()
+        {
+            for (size_t i = next++; i < entries.size(); i = next++)
+            {
+                const auto due = start + std::chrono::microseconds(
+                    static_cast<uint64_t>(static_cast<double>(entries[i].record.offsetUs) / options.speed));
+                if (!options.afap)
+                    std::this_thread::sleep_until(due);
+                auto& user = users.at(entries[i].record.userId);
+                {
+                    std::unique_lock<std::mutex> lock(user.mutex);
+                    user.turn.wait(lock, [&]() { return user.done == sequence[i]; });
+                }
+                const auto now = std::chrono::steady_clock::now();
+                if (!options.afap && now > due)
+                    results[i].lateUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - due).count());
+                failed[i] = issue(entries[i], endpoints, results[i]) ? 0 : 1;
+                {
+                    std::lock_guard<std::mutex> guard(user.mutex);
+                    ++user.done;
+                }
+                user.turn.notify_all();
+            }
+        };
+        std::vector<std::thread> workers;
+        for (uint32_t i = 0; i < options.connections; ++i)
+            workers.emplace_back(worker);
+        for (auto& w : workers)
+            w.join();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // Report.
+        std::map<uint16_t, size_t> statuses;
+        std::vector<uint64_t> latencies;
+        uint64_t bytes = 0, maxLate = 0;
+        size_t failures = 0, mismatches = 0;   // mismatches: responses whose status differs from the recorded one.
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            if (failed[i] != 0)
+            {
+                ++failures;
+                continue;
+            }
+            ++statuses[results[i].status];
+            if (entries[i].status != 0 && results[i].status != entries[i].status)
+                ++mismatches;
+            latencies.push_back(results[i].latencyUs);
+            bytes += entries[i].record.payloadSize;
+            maxLate = std::max(maxLate, results[i].lateUs);
+        }
+        std::sort(latencies.begin(), latencies.end());
+        std::cout << "Requests: " << entries.size() << " in " << seconds << "s (" << (static_cast<double>(entries.size()) / seconds)
+            << " req/s, " << (static_cast<double>(bytes) / seconds / 1048576.0) << " MB/s uploaded)" << std::endl
+            << "Failures: " << failures << std::endl
+            << "Status differs from trace: " << mismatches << std::endl
+            << "Latency us: p50 " << percentile(latencies, 0.50) << ", p99 " << percentile(latencies, 0.99)
+            << ", max " << (latencies.empty() ? 0 : latencies.back()) << std::endl;
+        if (!options.afap)
+            std::cout << "Max issue lateness us: " << maxLate << std::endl;
+        for (const auto& status : statuses)
+            std::cout << "Status " << status.first << ": " << status.second << std::endl;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Exception: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+/**
+   Maman 14
+   @CFaultInjector injects latency, jitter & errors into file system calls, emulating a degraded disk.
+   @author Roman Koifman
+ */
+
+#include "CFaultInjector.h"
+#include "Probes.h"
+#include <chrono>
+#include <random>
+#include <thread>
+
+std::atomic<bool> CFaultInjector::_enabled(false);
+uint32_t CFaultInjector::_latencyUs = 0;
+uint32_t CFaultInjector::_jitterUs = 0;
+uint32_t CFaultInjector::_errorPermille = 0;
+
+
+/**
+   @brief set the injected disk faults. Should be called before file system calls are made.
+   @param latencyUs latency added to each file system call.
+   @param jitterUs uniformly random latency added on top, up to this.
+   @param errorPermille file system calls failing, per 1000.
+ */
+void CFaultInjector::configure(const uint32_t latencyUs, const uint32_t jitterUs, const uint32_t errorPermille)
+{
+	_latencyUs = latencyUs;
+	_jitterUs = jitterUs;
+	_errorPermille = errorPermille;
+	_enabled = (latencyUs != 0 || jitterUs != 0 || errorPermille != 0);
+}
+
+
+/**
+   @brief delay the calling file system call, and decide whether it fails.
+   @return false if the call should fail. true otherwise.
+ */
+bool CFaultInjector::injectDisk()
+{
+	thread_local std::minstd_rand random(std::random_device{}());
+	uint32_t delayUs = _latencyUs;
+	if (_jitterUs != 0)
+		delayUs += static_cast<uint32_t>(random() % (_jitterUs + 1));
+	if (delayUs != 0)
+		std::this_thread::sleep_for(std::chrono::microseconds(delayUs));
+	const bool fail = (_errorPermille != 0 && (random() % 1000) < _errorPermille);
+	PROBE2(fault__disk, delayUs, fail);
+	return !fail;
+}
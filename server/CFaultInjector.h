@@ -0,0 +1,25 @@
+/**
+   Maman 14
+   @CFaultInjector injects latency, jitter & errors into file system calls (CFileHandler), emulating a degraded disk.
+           For testing only. Disabled unless configured (--fault-disk-*), costing a single branch per call.
+   @author Roman Koifman
+ */
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+class CFaultInjector
+{
+public:
+    static void configure(const uint32_t latencyUs, const uint32_t jitterUs, const uint32_t errorPermille);
+    static bool enabled() { return _enabled.load(std::memory_order_relaxed); }
+    static bool disk() { return !enabled() || injectDisk(); }
+
+private:
+    static std::atomic<bool> _enabled;
+    static uint32_t _latencyUs;       // added to each call.
+    static uint32_t _jitterUs;        // uniformly random extra latency, up to this.
+    static uint32_t _errorPermille;   // calls failing, per 1000.
+    static bool injectDisk();
+};
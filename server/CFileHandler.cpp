@@ -5,9 +5,35 @@
  */
 
 #include "CFileHandler.h"
+#include "CFaultInjector.h"
+#include "Probes.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
 #include <filesystem>  // cpp17
 #include <iostream>
 #include <fstream>
+#include <map>
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <linux/fs.h>     // FICLONE
+#include <sys/ioctl.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ZERO_SCAN_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define ZERO_SCAN_NEON
+#endif
 
 
 /**
@@ -19,14 +45,19 @@
  */
 bool CFileHandler::fileOpen(const std::string& filepath, std::fstream& fs, bool write)
 {
+	if (!CFaultInjector::disk())   // degraded disk emulation (--fault-disk-*). No-op unless configured.
+		return false;
 	try
 	{
 		if (filepath.empty())
 			return false;
 		// create directories within the path if they are do not exist.
+		PROBE1(file__mkdir__start, filepath.c_str());
 		(void) create_directories(std::filesystem::path(filepath).parent_path());
+		PROBE1(file__mkdir__done, filepath.c_str());
 		const auto flags = write ? (std::fstream::binary | std::fstream::out) : (std::fstream::binary | std::fstream::in);
 		fs.open(filepath, flags);
+		PROBE2(file__open__done, filepath.c_str(), fs.is_open());
 		return fs.is_open();
 	}
 	catch (std::exception&)
@@ -37,16 +68,21 @@ bool CFileHandler::fileOpen(const std::string& filepath, std::fstream& fs, bool
 
 
 /**
-   @brief close file stream.
+   @brief close file stream. Buffered writes are flushed first.
    @param fs file stream which will be closed.
-   @return true if closed successfully. false otherwise.
+   @return true if all writes reached the file and it closed successfully. false otherwise.
  */
 bool CFileHandler::fileClose(std::fstream& fs)
 {
+	if (!CFaultInjector::disk())
+		return false;
 	try
 	{
+		fs.flush();
+		const bool flushed = !fs.fail();
 		fs.close();
-		return true;
+		PROBE0(file__close__done);
+		return (flushed && !fs.fail());
 	}
 	catch (std::exception&)
 	{
@@ -64,12 +100,14 @@ bool CFileHandler::fileClose(std::fstream& fs)
  */
 bool CFileHandler::fileWrite(std::fstream& fs, const uint8_t* const file, const uint32_t bytes)
 {
+	if (!CFaultInjector::disk())
+		return false;
 	try
 	{
 		if (file == nullptr || bytes == 0)
 			return false;
 		fs.write(reinterpret_cast<const char*>(file), bytes);
-		return true;
+		return !fs.fail();
 	}
 	catch (std::exception&)
 	{
@@ -87,6 +125,8 @@ bool CFileHandler::fileWrite(std::fstream& fs, const uint8_t* const file, const
  */
 bool CFileHandler::fileRead(std::fstream& fs, uint8_t* const file, uint32_t bytes)
 {
+	if (!CFaultInjector::disk())
+		return false;
 	try
 	{
 		if (file == nullptr || bytes == 0)
@@ -123,6 +163,156 @@ uint32_t CFileHandler::fileSize(std::fstream& fs)
 	}
 }
 
+/**
+   @brief advance the write position of fs, leaving a hole (unallocated, reads as zeros) where the file is extended.
+   @param fs file stream opened for writing.
+   @param bytes bytes to skip.
+   @return true if skipped successfully. false otherwise.
+ */
+bool CFileHandler::fileSkip(std::fstream& fs, const uint32_t bytes)
+{
+	try
+	{
+		fs.seekp(bytes, std::fstream::cur);
+		return !fs.fail();
+	}
+	catch (std::exception&)
+	{
+		return false;
+	}
+}
+
+
+/**
+   @brief move the read position of fs.
+   @param fs file stream opened for reading.
+   @param offset the position from the file's start.
+   @return true if moved successfully. false otherwise.
+ */
+bool CFileHandler::fileSeek(std::fstream& fs, const uint32_t offset)
+{
+	try
+	{
+		fs.clear();
+		fs.seekg(offset, std::fstream::beg);
+		return !fs.fail();
+	}
+	catch (std::exception&)
+	{
+		return false;
+	}
+}
+
+
+/**
+   @brief set a closed file's size. An extended file ends with a hole.
+   @param filepath the file to resize.
+   @param size the new size.
+   @return true if resized successfully. false otherwise.
+ */
+bool CFileHandler::fileResize(const std::string& filepath, const uint32_t size)
+{
+	std::error_code error;
+	std::filesystem::resize_file(filepath, size, error);
+	return !error;
+}
+
+
+/**
+   @brief retrieve the data extents of a file (SEEK_DATA / SEEK_HOLE), i.e. the file without its holes.
+          Where holes are not reported (other platforms, filesystems without hole support), the whole file is one extent.
+   @param filepath the file to map.
+   @param size the file's size. Extents are clipped to it.
+   @param extents the (offset, length) data extents in ascending order. Empty if the file is entirely a hole.
+   @return true if mapped successfully. false otherwise.
+ */
+bool CFileHandler::fileExtents(const std::string& filepath, const uint32_t size, std::vector<std::pair<uint32_t, uint32_t>>& extents)
+{
+	extents.clear();
+#if defined(__linux__) && defined(SEEK_DATA) && defined(SEEK_HOLE)
+	const int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	bool mapped = true;
+	off_t offset = 0;
+	while (offset < static_cast<off_t>(size))
+	{
+		const off_t data = ::lseek(fd, offset, SEEK_DATA);
+		if (data < 0)
+		{
+			mapped = (errno == ENXIO);   // no data beyond offset.
+			break;
+		}
+		if (data >= static_cast<off_t>(size))
+			break;
+		off_t hole = ::lseek(fd, data, SEEK_HOLE);
+		if (hole < 0)
+		{
+			mapped = false;
+			break;
+		}
+		if (hole > static_cast<off_t>(size))
+			hole = static_cast<off_t>(size);
+		extents.emplace_back(static_cast<uint32_t>(data), static_cast<uint32_t>(hole - data));
+		offset = hole;
+	}
+	(void)::close(fd);
+	if (mapped)
+		return true;
+	extents.clear();
+#else
+	(void)filepath;
+#endif
+	if (size != 0)
+		extents.emplace_back(0, size);
+	return true;
+}
+
+
+/**
+   @brief check whether a block is all zeros. Scans 64 bytes per step with SIMD (SSE2 / NEON) where available.
+   @param data the block.
+   @param bytes the block's size.
+   @return true if all bytes are zero.
+ */
+bool CFileHandler::zeroBlock(const uint8_t* const data, const uint32_t bytes)
+{
+	uint32_t i = 0;
+#if defined(ZERO_SCAN_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 64 <= bytes; i += 64)
+	{
+		const __m128i* const block = reinterpret_cast<const __m128i*>(data + i);
+		const __m128i any = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(block), _mm_loadu_si128(block + 1)),
+		                                 _mm_or_si128(_mm_loadu_si128(block + 2), _mm_loadu_si128(block + 3)));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF)
+			return false;
+	}
+#elif defined(ZERO_SCAN_NEON)
+	for (; i + 64 <= bytes; i += 64)
+	{
+		const uint8_t* const block = data + i;
+		const uint8x16_t any = vorrq_u8(vorrq_u8(vld1q_u8(block), vld1q_u8(block + 16)),
+		                                vorrq_u8(vld1q_u8(block + 32), vld1q_u8(block + 48)));
+		if (vmaxvq_u8(any) != 0)
+			return false;
+	}
+#endif
+	for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t))
+	{
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		if (word != 0)
+			return false;
+	}
+	for (; i < bytes; ++i)
+	{
+		if (data[i] != 0)
+			return false;
+	}
+	return true;
+}
+
 /**
    @brief Retrieve a list of file names given a folder path.
    @param folderPath the folder to read from
@@ -146,6 +336,31 @@ bool CFileHandler::getFilesList(std::string& folderPath, std::set<std::string>&
 	}
 }
 
+/**
+   @brief Retrieve a list of file names given a folder path, in directory order (readdir).
+   @param folderPath the folder to read from
+   @param filesList the list to append the file names to.
+   @return false if error occurred. true, if filesList valid.
+ */
+bool CFileHandler::getFilesList(const std::string& folderPath, std::vector<std::string>& filesList)
+{
+	try
+	{
+		for (const auto& entry : std::filesystem::directory_iterator(folderPath))
+		{
+			if (entry.is_regular_file())
+				filesList.push_back(entry.path().filename().string());
+		}
+		return true;
+	}
+	catch(std::exception&)
+	{
+		filesList.clear();
+		return false;
+	}
+}
+
+
 /**
    @brief Check if file exists given a file path.
    @param filePath the file's filepath.
@@ -168,6 +383,26 @@ bool CFileHandler::fileExists(const std::string& filePath)
 }
 
 
+/**
+   @brief Check if folder exists given a folder path.
+   @param folderPath the folder's path.
+   @return true if folder exists.
+ */
+bool CFileHandler::folderExists(const std::string& folderPath)
+{
+	if (folderPath.empty())
+		return false;
+
+	try
+	{
+		return std::filesystem::is_directory(folderPath);
+	}
+	catch (std::exception&)
+	{
+		return false;
+	}
+}
+
 
 /**
    @brief Removes a file given a file path.
@@ -177,6 +412,8 @@ bool CFileHandler::fileExists(const std::string& filePath)
  */
 bool CFileHandler::fileRemove(const std::string& filePath)
 {
+	if (!CFaultInjector::disk())
+		return false;
 	try
 	{
 		return (0 == std::remove(filePath.c_str()));   // 0 upon success..
@@ -185,4 +422,306 @@ bool CFileHandler::fileRemove(const std::string& filePath)
 	{
 		return false;
 	}
-}
\ No newline at end of file
+}
+
+/**
+   @brief Removes a folder and all of its content given a folder path.
+   @param folderPath the folder to remove.
+   @return true if the folder doesn't exist anymore. False, otherwise.
+ */
+bool CFileHandler::folderRemove(const std::string& folderPath)
+{
+	try
+	{
+		(void)std::filesystem::remove_all(folderPath);
+		return true;
+	}
+	catch (std::exception&)
+	{
+		return false;
+	}
+}
+
+
+/**
+   @brief Create a folder, including its parent folders, if it doesn't exist.
+   @param folderPath the folder to create.
+   @return true if the folder exists. False, otherwise.
+ */
+bool CFileHandler::folderCreate(const std::string& folderPath)
+{
+	try
+	{
+		(void)create_directories(std::filesystem::path(folderPath));
+		return std::filesystem::is_directory(folderPath);
+	}
+	catch (std::exception&)
+	{
+		return false;
+	}
+}
+
+
+/**
+   @brief Get the space available for writing on the filesystem of a folder.
+   @param folderPath the folder to check.
+   @param bytes available bytes will be saved in this object.
+   @return true upon success. False, otherwise.
+ */
+bool CFileHandler::freeSpace(const std::string& folderPath, uint64_t& bytes)
+{
+	try
+	{
+		bytes = static_cast<uint64_t>(std::filesystem::space(folderPath).available);
+		return true;
+	}
+	catch (std::exception&)
+	{
+		bytes = 0;
+		return false;
+	}
+}
+
+
+/**
+   @brief Flush data and directory entries of the given (closed) files to stable storage.
+          Few files are flushed one by one with fdatasync, followed by an fsync of their folders & the folders' parents.
+          Many files are flushed with a single syncfs per filesystem, which covers the directory entries as well.
+   @param filepaths the files to flush.
+   @param synced whether each file (by index) was flushed with its directory entry will be saved in this object.
+          A failure fails only the files it concerns, e.g. those of a folder or filesystem which failed to sync.
+   @return true if all files were flushed successfully. false, otherwise.
+ */
+bool CFileHandler::filesSync(const std::vector<std::string>& filepaths, std::vector<bool>& synced)
+{
+	synced.assign(filepaths.size(), false);
+	if (!CFaultInjector::disk())
+		return false;
+	PROBE1(file__sync__start, filepaths.size());
+#if defined(_WIN32)
+	for (size_t i = 0; i < filepaths.size(); ++i)   // NTFS journals directory entries. Flushing file data is sufficient.
+	{
+		const int fd = _open(filepaths[i].c_str(), _O_RDWR | _O_BINARY);
+		if (fd < 0)
+			continue;
+		synced[i] = (_commit(fd) == 0);
+		(void)_close(fd);
+	}
+#else
+	std::map<std::string, std::vector<size_t>> folders;   // folder to sync, and the files whose entries it holds.
+	std::map<dev_t, std::pair<int, std::vector<size_t>>> filesystems;   // one open descriptor per filesystem, and its files.
+	const bool perFilesystem = (filepaths.size() >= SYNCFS_THRESHOLD);
+	for (size_t i = 0; i < filepaths.size(); ++i)
+	{
+		const int fd = ::open(filepaths[i].c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+#if defined(__linux__)
+		struct stat st;
+		if (perFilesystem && (::fstat(fd, &st) == 0))
+		{
+			auto filesystem = filesystems.emplace(st.st_dev, std::make_pair(fd, std::vector<size_t>()));
+			if (!filesystem.second)
+				(void)::close(fd);   // a descriptor of this filesystem is already kept open for syncfs.
+			filesystem.first->second.second.push_back(i);
+			continue;
+		}
+		const bool flushed = (::fdatasync(fd) == 0);
+#else
+		(void)perFilesystem;
+		const bool flushed = (::fsync(fd) == 0);
+#endif
+		(void)::close(fd);
+		if (!flushed)
+			continue;
+		synced[i] = true;
+		const std::filesystem::path folder = std::filesystem::path(filepaths[i]).parent_path();
+		folders[folder.string()].push_back(i);
+		folders[folder.parent_path().string()].push_back(i);   // the folder's own entry, in case it was just created.
+	}
+
+#if defined(__linux__)
+	for (const auto& filesystem : filesystems)
+	{
+		const bool flushed = (::syncfs(filesystem.second.first) == 0);
+		(void)::close(filesystem.second.first);
+		for (const size_t i : filesystem.second.second)
+			synced[i] = flushed;
+	}
+#endif
+
+	for (const auto& folder : folders)
+	{
+		const int fd = ::open(folder.first.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		const bool flushed = (fd >= 0 && ::fsync(fd) == 0);
+		if (fd >= 0)
+			(void)::close(fd);
+		if (flushed)
+			continue;
+		for (const size_t i : folder.second)
+			synced[i] = false;
+	}
+#endif
+	const bool success = (std::find(synced.begin(), synced.end(), false) == synced.end());
+	PROBE2(file__sync__done, filepaths.size(), success);
+	return success;
+}
+
+
+
+/**
+   @brief Reflink a file: the copy shares the source's extents (copy-on-write) and costs no data I/O.
+          Supported by some filesystems only (e.g. btrfs, xfs). Nothing is copied elsewhere.
+          Not subject to fault injection: callers fall back to an operation which is, so each operation faults once.
+          Create folders in destination path if do not exist.
+   @param source the file to copy.
+   @param destination the copy's filepath. Overwritten if exists.
+   @return true if reflinked successfully. false otherwise, e.g. where unsupported.
+ */
+bool CFileHandler::fileReflink(const std::string& source, const std::string& destination)
+{
+	try
+	{
+		if (source.empty() || destination.empty())
+			return false;
+		(void)create_directories(std::filesystem::path(destination).parent_path());
+#if defined(__linux__) && defined(FICLONE)
+		const int src = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+		if (src >= 0)
+		{
+			const int dst = ::open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			const bool cloned = (dst >= 0) && (::ioctl(dst, FICLONE, src) == 0);
+			if (dst >= 0)
+				(void)::close(dst);
+			(void)::close(src);
+			if (!cloned && dst >= 0)
+				(void)::unlink(destination.c_str());
+			return cloned;
+		}
+#endif
+		return false;
+	}
+	catch (std::exception&)
+	{
+		return false;
+	}
+}
+
+
+/**
+   @brief Copy a file within the kernel (copy_file_range), without passing the data through user space.
+          The filesystem may share extents instead of copying (e.g. btrfs, xfs, NFS server side copy).
+          Falls back to a regular copy where unsupported. Create folders in destination path if do not exist.
+   @param source the file to copy.
+   @param destination the copy's filepath. Overwritten if exists.
+   @return true if copied successfully. false otherwise.
+ */
+bool CFileHandler::fileCopy(const std::string& source, const std::string& destination)
+{
+	if (!CFaultInjector::disk())
+		return false;
+	return copy(source, destination);
+}
+
+
+/**
+   @brief fileCopy() without fault injection, for operations built upon it that were already subjected to it.
+ */
+bool CFileHandler::copy(const std::string& source, const std::string& destination)
+{
+	try
+	{
+		if (source.empty() || destination.empty())
+			return false;
+		(void)create_directories(std::filesystem::path(destination).parent_path());
+#if defined(__linux__)
+		const int src = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+		if (src < 0)
+			return false;
+		const int dst = ::open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (dst < 0)
+		{
+			(void)::close(src);
+			return false;
+		}
+		PROBE2(file__copy__start, source.c_str(), destination.c_str());
+		bool copied = true;
+		bool supported = true;
+		for (;;)
+		{
+			const ssize_t bytes = ::copy_file_range(src, nullptr, dst, nullptr, SSIZE_MAX, 0);
+			if (bytes > 0)
+				continue;
+			if (bytes < 0)
+			{
+				copied = false;
+				// e.g. cross filesystem copy on older kernels. Nothing was copied yet, since these fail upfront.
+				supported = (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP);
+			}
+			break;
+		}
+		(void)::close(dst);
+		(void)::close(src);
+		PROBE2(file__copy__done, destination.c_str(), copied);
+		if (copied || supported)
+			return copied;
+#endif
+		return std::filesystem::copy_file(source, destination, std::filesystem::copy_options::overwrite_existing);
+	}
+	catch (std::exception&)
+	{
+		return false;
+	}
+}
+
+
+/**
+   @brief Rename a file (rename(2)), replacing the destination atomically if it exists.
+          Across filesystems, the file is copied & the source removed.
+          Create folders in destination path if do not exist.
+   @param source the file to rename.
+   @param destination the new filepath.
+   @return true if renamed successfully. false otherwise.
+ */
+bool CFileHandler::fileRename(const std::string& source, const std::string& destination)
+{
+	if (!CFaultInjector::disk())
+		return false;
+	try
+	{
+		if (source.empty() || destination.empty())
+			return false;
+		(void)create_directories(std::filesystem::path(destination).parent_path());
+		std::error_code error;
+		std::filesystem::rename(source, destination, error);
+		PROBE2(file__rename__done, destination.c_str(), !error);
+		if (!error)
+			return true;
+		if (error != std::errc::cross_device_link)
+			return false;
+		return (copy(source, destination) && (0 == std::remove(source.c_str())));
+	}
+	catch (std::exception&)
+	{
+		return false;
+	}
+}
+
+
+/**
+   @brief Advise the kernel that a file is about to be read (POSIX_FADV_WILLNEED), starting its read ahead
+          into the page cache in the background. No-op where unsupported.
+   @param filepath the file to read ahead.
+ */
+void CFileHandler::fileAdvise(const std::string& filepath)
+{
+#if defined(POSIX_FADV_WILLNEED)
+	const int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+	(void)::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	(void)::close(fd);
+#else
+	(void)filepath;
+#endif
+}
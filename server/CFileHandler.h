@@ -5,20 +5,43 @@
  */
 
 #pragma once
+#include <cstdint>
 #include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 class CFileHandler
 {
+#define SYNCFS_THRESHOLD  8   // from this many files, a single syncfs per filesystem replaces per-file fdatasync.
+                              // syncfs also flushes the folders' entries (all dirty metadata of the filesystem),
+                              // hence the folders & parents fsync of the fdatasync path is skipped there.
+    bool copy(const std::string& source, const std::string& destination);
+
 public:
     bool fileOpen(const std::string& filepath, std::fstream& fs, bool write=false);
     bool fileClose(std::fstream& fs);
     bool fileWrite(std::fstream& fs, const uint8_t* const file, const uint32_t bytes);
     bool fileRead(std::fstream& fs, uint8_t* const file, uint32_t bytes);
     uint32_t fileSize(std::fstream& fs);
+    bool fileSkip(std::fstream& fs, const uint32_t bytes);
+    bool fileSeek(std::fstream& fs, const uint32_t offset);
+    bool fileResize(const std::string& filepath, const uint32_t size);
+    bool fileExtents(const std::string& filepath, const uint32_t size, std::vector<std::pair<uint32_t, uint32_t>>& extents);
+    static bool zeroBlock(const uint8_t* const data, const uint32_t bytes);
 	
     bool getFilesList(std::string& filepath, std::set<std::string>& filesList);
+    bool getFilesList(const std::string& folderPath, std::vector<std::string>& filesList);
     bool fileExists(const std::string& filepath);
+    bool folderExists(const std::string& folderPath);
     bool fileRemove(const std::string& filepath);
+    bool folderRemove(const std::string& folderPath);
+    bool folderCreate(const std::string& folderPath);
+    bool freeSpace(const std::string& folderPath, uint64_t& bytes);
+    bool filesSync(const std::vector<std::string>& filepaths, std::vector<bool>& synced);
+    bool fileReflink(const std::string& source, const std::string& destination);
+    bool fileCopy(const std::string& source, const std::string& destination);
+    bool fileRename(const std::string& source, const std::string& destination);
+    void fileAdvise(const std::string& filepath);
 };
 
@@ -0,0 +1,369 @@
+/**
+   Maman 14
+   @CFileStorage storage backend keeping users' files on the file system, across one or more backup folders.
+   @author Roman Koifman
+ */
+
+#include "CFileStorage.h"
+
+
+CFileStorage::CFileWriteStream::CFileWriteStream(CFileStorage& storage, const std::string& root, const std::string& filepath,
+	const std::vector<std::string>& versions) :
+	_storage(storage), _root(root), _filepath(filepath), _versions(versions), _bytes(0), _size(0), _hole(0), _writeTime(0)
+{
+}
+
+/**
+   @brief open the file for writing. Create folders in filepath if do not exist.
+ */
+bool CFileStorage::CFileWriteStream::open()
+{
+	return _storage._fileHandler.fileOpen(_filepath, _fs, true);
+}
+
+/**
+   @brief write the next bytes of the file. All-zero blocks are skipped rather than written, so that
+          zero runs spanning whole filesystem blocks remain holes (sparse file), costing no disk space or I/O.
+ */
+bool CFileStorage::CFileWriteStream::write(const uint8_t* const data, const uint32_t bytes)
+{
+	if (data == nullptr || bytes == 0)   // as CFileHandler::fileWrite. e.g. an empty backup fails rather than storing an empty file.
+		return false;
+	_size += bytes;
+	if (CFileHandler::zeroBlock(data, bytes))
+	{
+		_hole += bytes;
+		return true;
+	}
+	const auto start = std::chrono::steady_clock::now();
+	if (_hole != 0 && !_storage._fileHandler.fileSkip(_fs, _hole))
+		return false;
+	_hole = 0;
+	if (!_storage._fileHandler.fileWrite(_fs, data, bytes))
+		return false;
+	_writeTime += std::chrono::steady_clock::now() - start;
+	_bytes += bytes;
+	return true;
+}
+
+/**
+   @brief close the file. In durable mode, return only once it is on stable storage.
+          The root's write latency accounts the data writes (including the final flush) and the sync round only:
+          neither folders creation on open nor the group commit's batching delay reflect the disk's speed.
+ */
+bool CFileStorage::CFileWriteStream::commit()
+{
+	const auto start = std::chrono::steady_clock::now();
+	if (!_storage._fileHandler.fileClose(_fs))
+		return false;
+	_writeTime += std::chrono::steady_clock::now() - start;
+	if (_hole != 0 && !_storage._fileHandler.fileResize(_filepath, _size))   // trailing hole.
+		return false;
+	std::chrono::steady_clock::duration syncTime(0);
+	std::vector<std::string> changed(_versions);
+	changed.push_back(_filepath);
+	if (_storage._durable && !_storage._groupCommit.commit(changed, syncTime))  // data & directory entries on stable storage.
+		return false;
+	_writeTime += syncTime;
+	_storage._placement.reportWrite(_root, _bytes, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(_writeTime).count()));
+	return true;
+}
+
+
+bool CFileStorage::CFileReadStream::open(const std::string& filepath)
+{
+	if (!_fileHandler.fileOpen(filepath, _fs))
+		return false;
+	_filepath = filepath;
+	_size = _fileHandler.fileSize(_fs);
+	return true;
+}
+
+bool CFileStorage::CFileReadStream::read(uint8_t* const data, const uint32_t bytes)
+{
+	return _fileHandler.fileRead(_fs, data, bytes);
+}
+
+bool CFileStorage::CFileReadStream::seek(const uint32_t offset)
+{
+	return _fileHandler.fileSeek(_fs, offset);
+}
+
+/**
+   @brief map the file's data, skipping its holes.
+ */
+bool CFileStorage::CFileReadStream::extents(TExtents& extents)
+{
+	return _fileHandler.fileExtents(_filepath, _size, extents);
+}
+
+
+/**
+   @brief configure backup folders, versions retention and durability.
+   @param config the server settings.
+   @param err description error. applicable only if function returns false.
+   @return true if initialized successfully. false otherwise.
+ */
+bool CFileStorage::initialize(const CServerConfig& config, std::stringstream& err)
+{
+	if (!_placement.configure(config.roots, config.placePerFile ? CVolumePlacement::PER_FILE : CVolumePlacement::PER_USER, err))
+		return false;
+	_versionStore.configure(config.keepVersions, config.versionMaxAgeSec);
+	_durable = config.durable;
+	if (_durable && !_groupCommit.start(config.commitDelayMs))
+	{
+		err << "CFileStorage::initialize: Failed to start group commit thread!" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+
+/**
+   @brief stop the group commit thread. Pending commits are completed.
+ */
+void CFileStorage::shutdown()
+{
+	_groupCommit.stop();
+}
+
+
+/**
+   @brief open a file for backup. An existing file is overwritten where it is, after keeping its content as a version.
+          A new file is placed on a backup folder.
+   @param size the file's expected size.
+   @param error failure reason. applicable only if nullptr is returned.
+   @return the opened stream. nullptr upon failure.
+ */
+std::unique_ptr<CStorage::CWriteStream> CFileStorage::put(const uint32_t userId, const std::string& filename, const uint32_t size, EError& error)
+{
+	(void)size;
+	const std::string root = _placement.place(userId, filename);
+	const std::string filepath = _placement.filePath(root, userId, filename);
+	std::vector<std::string> versions;   // the version kept, committed along with the file.
+	if (_versionStore.enabled() && _fileHandler.fileExists(filepath) &&
+		!_versionStore.snapshot(root, userId, filename, filepath, versions))
+	{
+		error = ERROR_VERSION_KEEP;
+		return nullptr;
+	}
+	auto stream = std::make_unique<CFileWriteStream>(*this, root, filepath, versions);
+	if (!stream->open())
+	{
+		error = ERROR_FILE_OPEN;
+		return nullptr;
+	}
+	_placement.remember(userId, filename, root);   // the file exists from now on.
+	return stream;
+}
+
+
+/**
+   @brief open a stored file for reading.
+   @param version 0 for the current content. N for the Nth previous version.
+   @param error failure reason. applicable only if nullptr is returned.
+   @return the opened stream. nullptr upon failure.
+ */
+std::unique_ptr<CStorage::CReadStream> CFileStorage::get(const uint32_t userId, const std::string& filename, const uint32_t version, EError& error)
+{
+	std::string root;
+	if (!_placement.locate(userId, filename, root))
+	{
+		error = ERROR_NOT_EXIST;
+		return nullptr;
+	}
+	std::string filepath = _placement.filePath(root, userId, filename);
+	if (version != 0 && !_versionStore.versionPath(root, userId, filename, version, filepath))
+	{
+		error = ERROR_VERSION_NOT_EXIST;
+		return nullptr;
+	}
+	auto stream = std::make_unique<CFileReadStream>();
+	if (!stream->open(filepath))
+	{
+		error = ERROR_FILE_OPEN;
+		return nullptr;
+	}
+	return stream;
+}
+
+
+/**
+   @brief remove a file, then its versions. A failure leaves either the file with its versions, or orphaned versions
+          only. Never the file without its history.
+   @return true if removed successfully. false if file doesn't exist or removal failed.
+ */
+bool CFileStorage::remove(const uint32_t userId, const std::string& filename)
+{
+	std::string root;
+	if (!_placement.locate(userId, filename, root))
+		return false;
+	if (!_fileHandler.fileRemove(_placement.filePath(root, userId, filename)))
+		return false;
+	_placement.forget(userId, filename);
+	return _versionStore.removeVersions(root, userId, filename);
+}
+
+
+/**
+   @brief copy or rename a file within a user's files. An existing destination stays on its backup folder,
+          a new one is placed beside the source. Hence, data never moves across disks needlessly.
+   @param move rename if true. copy otherwise.
+   @param error failure reason. applicable only if false is returned.
+   @return true if succeeded. false otherwise.
+ */
+bool CFileStorage::relocate(const uint32_t userId, const std::string& source, const std::string& destination, const bool move, EError& error)
+{
+	std::string sourceRoot;
+	if (!_placement.locate(userId, source, sourceRoot))
+	{
+		error = ERROR_NOT_EXIST;
+		return false;
+	}
+	if (source == destination)
+		return true;
+	std::string destinationRoot;
+	if (!_placement.locate(userId, destination, destinationRoot))
+		destinationRoot = sourceRoot;
+	const std::string sourcePath = _placement.filePath(sourceRoot, userId, source);
+	const std::string destinationPath = _placement.filePath(destinationRoot, userId, destination);
+	std::vector<std::string> changed;   // files whose directory entries changed. committed in durable mode.
+	if (_versionStore.enabled() && _fileHandler.fileExists(destinationPath) &&
+		!_versionStore.snapshot(destinationRoot, userId, destination, destinationPath, changed))
+	{
+		error = ERROR_VERSION_KEEP;
+		return false;
+	}
+	if (move)
+	{
+		if (!_fileHandler.fileRename(sourcePath, destinationPath))
+		{
+			error = ERROR_FILE_RENAME;
+			return false;
+		}
+		_placement.forget(userId, source);
+		if (!_versionStore.moveVersions(sourceRoot, destinationRoot, userId, source, destination, changed))   // versions follow the file.
+		{
+			error = ERROR_VERSION_KEEP;
+			return false;
+		}
+	}
+	else if (!_fileHandler.fileCopy(sourcePath, destinationPath))
+	{
+		error = ERROR_FILE_COPY;
+		return false;
+	}
+	_placement.remember(userId, destination, destinationRoot);
+	changed.push_back(destinationPath);
+	std::chrono::steady_clock::duration syncTime;
+	if (_durable && !_groupCommit.commit(changed, syncTime))  // data & directory entries on stable storage.
+	{
+		error = ERROR_FILE_COMMIT;
+		return false;
+	}
+	return true;
+}
+
+bool CFileStorage::copy(const uint32_t userId, const std::string& source, const std::string& destination, EError& error)
+{
+	return relocate(userId, source, destination, false, error);
+}
+
+bool CFileStorage::rename(const uint32_t userId, const std::string& source, const std::string& destination, EError& error)
+{
+	return relocate(userId, source, destination, true, error);
+}
+
+
+/**
+   @brief list a user's files from all backup folders.
+   @param files file names will be added to this object.
+   @return false if error occurred. true, if files is valid.
+ */
+bool CFileStorage::list(const uint32_t userId, std::set<std::string>& files)
+{
+	for (const auto& root : _placement.roots())
+	{
+		std::string userFolder(_placement.userFolder(root, userId));
+		if (!_fileHandler.folderExists(userFolder))
+			continue;
+		if (!_fileHandler.getFilesList(userFolder, files))
+			return false;
+	}
+	return true;
+}
+
+
+/**
+   @brief count the previous versions of a file.
+   @param count the versions count will be saved in this object.
+   @return false if error occurred. true, if count is valid.
+ */
+bool CFileStorage::versions(const uint32_t userId, const std::string& filename, uint32_t& count)
+{
+	count = 0;
+	std::string root;
+	std::vector<std::string> versions;
+	if (!_placement.locate(userId, filename, root) || !_versionStore.listVersions(root, userId, filename, versions))
+		return false;
+	count = static_cast<uint32_t>(versions.size());
+	return true;
+}
+
+
+bool CFileStorage::exists(const uint32_t userId, const std::string& filename)
+{
+	std::string root;
+	return _placement.locate(userId, filename, root);
+}
+
+
+/**
+   @brief list a user's files starting with prefix, root by root in directory order (readdir), as they are laid out
+          in the folders rather than sorted by name. Each file's location is the index of its root.
+ */
+bool CFileStorage::scan(const uint32_t userId, const std::string& prefix, std::vector<SScanEntry>& files)
+{
+	files.clear();
+	const auto& roots = _placement.roots();
+	for (uint32_t r = 0; r < roots.size(); ++r)
+	{
+		std::string userFolder(_placement.userFolder(roots[r], userId));
+		if (!_fileHandler.folderExists(userFolder))
+			continue;
+		std::vector<std::string> folderFiles;
+		if (!_fileHandler.getFilesList(userFolder, folderFiles))
+			return false;
+		for (const auto& fn : folderFiles)
+		{
+			if (fn.compare(0, prefix.size(), prefix) == 0)
+				files.emplace_back(fn, r);
+		}
+	}
+	return true;
+}
+
+/**
+   @brief start reading a scanned file ahead into the page cache, before it is requested.
+ */
+void CFileStorage::prefetch(const uint32_t userId, const SScanEntry& file)
+{
+	_fileHandler.fileAdvise(_placement.filePath(_placement.roots()[file.location], userId, file.filename));
+}
+
+
+/**
+   @brief open a scanned file for reading, on the root it was found on.
+   @param error failure reason. applicable only if nullptr is returned.
+   @return the opened stream. nullptr upon failure.
+ */
+std::unique_ptr<CStorage::CReadStream> CFileStorage::getScanned(const uint32_t userId, const SScanEntry& file, EError& error)
+{
+	auto stream = std::make_unique<CFileReadStream>();
+	if (!stream->open(_placement.filePath(_placement.roots()[file.location], userId, file.filename)))
+	{
+		error = ERROR_FILE_OPEN;
+		return nullptr;
+	}
+	return stream;
+}
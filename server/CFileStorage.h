@@ -0,0 +1,76 @@
+/**
+   Maman 14
+   @CFileStorage storage backend keeping users' files on the file system, across one or more backup folders.
+   @author Roman Koifman
+ */
+
+#pragma once
+#include "CStorage.h"
+#include "CFileHandler.h"
+#include "CGroupCommit.h"
+#include "CVersionStore.h"
+#include "CVolumePlacement.h"
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+class CFileStorage : public CStorage
+{
+    class CFileWriteStream : public CWriteStream
+    {
+        CFileStorage& _storage;
+        std::string   _root;
+        std::string   _filepath;
+        std::vector<std::string> _versions;   // versions kept of the overwritten file. committed along with it.
+        std::fstream  _fs;
+        uint64_t      _bytes;   // data written. all-zero blocks are skipped, leaving holes.
+        uint32_t      _size;    // logical size.
+        uint32_t      _hole;    // zero bytes skipped since the last data write.
+        std::chrono::steady_clock::duration _writeTime;   // disk time is accounted for placement weights.
+    public:
+        CFileWriteStream(CFileStorage& storage, const std::string& root, const std::string& filepath, const std::vector<std::string>& versions);
+        bool open();
+        bool write(const uint8_t* const data, const uint32_t bytes) override;
+        bool commit() override;
+    };
+
+    class CFileReadStream : public CReadStream
+    {
+        CFileHandler  _fileHandler;
+        std::fstream  _fs;
+        std::string   _filepath;
+        uint32_t      _size;
+    public:
+        CFileReadStream() : _size(0) {}
+        bool open(const std::string& filepath);
+        uint32_t size() const override { return _size; }
+        bool read(uint8_t* const data, const uint32_t bytes) override;
+        bool seek(const uint32_t offset) override;
+        bool extents(TExtents& extents) override;
+    };
+
+    CFileHandler     _fileHandler;
+    CVolumePlacement _placement;
+    CVersionStore    _versionStore;
+    CGroupCommit     _groupCommit;
+    bool             _durable;
+
+    bool relocate(const uint32_t userId, const std::string& source, const std::string& destination, const bool move, EError& error);
+
+public:
+    CFileStorage() : _durable(false) {}
+    bool initialize(const CServerConfig& config, std::stringstream& err) override;
+    void shutdown() override;
+
+    std::unique_ptr<CWriteStream> put(const uint32_t userId, const std::string& filename, const uint32_t size, EError& error) override;
+    std::unique_ptr<CReadStream> get(const uint32_t userId, const std::string& filename, const uint32_t version, EError& error) override;
+    bool remove(const uint32_t userId, const std::string& filename) override;
+    bool copy(const uint32_t userId, const std::string& source, const std::string& destination, EError& error) override;
+    bool rename(const uint32_t userId, const std::string& source, const std::string& destination, EError& error) override;
+    bool list(const uint32_t userId, std::set<std::string>& files) override;
+    bool versions(const uint32_t userId, const std::string& filename, uint32_t& count) override;
+    bool exists(const uint32_t userId, const std::string& filename) override;
+    bool scan(const uint32_t userId, const std::string& prefix, std::vector<SScanEntry>& files) override;
+    void prefetch(const uint32_t userId, const SScanEntry& file) override;
+    std::unique_ptr<CReadStream> getScanned(const uint32_t userId, const SScanEntry& file, EError& error) override;
+};
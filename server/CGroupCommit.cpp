@@ -0,0 +1,127 @@
+/**
+   Maman 14
+   @CGroupCommit batches durable file commits of concurrent requests into shared sync rounds.
+   @author Roman Koifman
+ */
+
+#include "CGroupCommit.h"
+#include <algorithm>
+#include <chrono>
+
+
+CGroupCommit::~CGroupCommit()
+{
+	stop();
+}
+
+
+/**
+   @brief start the committing thread.
+   @param maxDelayMs maximum time a batch waits for more files before its sync round starts.
+   @return true if started successfully. false otherwise.
+ */
+bool CGroupCommit::start(const uint32_t maxDelayMs)
+{
+	std::lock_guard<std::mutex> guard(_mutex);
+	if (_running)
+		return true;
+	try
+	{
+		_maxDelayMs = maxDelayMs;
+		_running = true;
+		_thread = std::thread(&CGroupCommit::run, this);
+		return true;
+	}
+	catch (std::exception&)
+	{
+		_running = false;
+		return false;
+	}
+}
+
+
+/**
+   @brief stop the committing thread. Files already waiting are committed before it exits.
+ */
+void CGroupCommit::stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		if (!_running)
+			return;
+		_running = false;
+	}
+	_arrived.notify_all();
+	if (_thread.joinable())
+		_thread.join();
+}
+
+
+/**
+   @brief block until written & closed files are on stable storage. Files changed together (e.g. a file and the
+          version kept of it) join the open batch at once, and are synced together with all files of concurrent requests.
+   @param filepaths the files to commit.
+   @param syncTime the files' share of the sync round they were committed in (the round's duration over its files),
+          excluding the time they waited for the batch to fill (up to maxDelayMs). Measures the disk rather than the batching.
+   @return true if all files were committed successfully. false otherwise.
+ */
+bool CGroupCommit::commit(const std::vector<std::string>& filepaths, std::chrono::steady_clock::duration& syncTime)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	if (!_running)
+	{
+		lock.unlock();
+		const auto start = std::chrono::steady_clock::now();
+		std::vector<bool> synced;
+		const bool success = _fileHandler.filesSync(filepaths, synced);   // no committing thread. sync inline.
+		syncTime = std::chrono::steady_clock::now() - start;
+		return success;
+	}
+	auto batch = _batch;
+	const size_t first = batch->files.size();   // this committer's files are [first, first + filepaths.size()).
+	batch->files.insert(batch->files.end(), filepaths.begin(), filepaths.end());
+	_arrived.notify_one();
+	_committed.wait(lock, [&batch]() { return batch->done; });
+	syncTime = batch->syncTime * static_cast<int64_t>(filepaths.size());
+	const auto synced = batch->synced.begin() + static_cast<std::ptrdiff_t>(first);
+	return std::all_of(synced, synced + static_cast<std::ptrdiff_t>(filepaths.size()), [](const bool ok) { return ok; });
+}
+
+
+/**
+   @brief committing thread's loop. Once a batch has files, it waits until either as many files as the previous
+          batch have joined, or maxDelayMs passed. Under low load a batch is therefore committed immediately,
+          while under high load the batch grows with the concurrency and one sync round serves many requests.
+ */
+void CGroupCommit::run()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	for (;;)
+	{
+		_arrived.wait(lock, [this]() { return !_running || !_batch->files.empty(); });
+		if (_batch->files.empty())
+			return;  // stopped & nothing to commit.
+
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_maxDelayMs);
+		const size_t expected = std::min<size_t>(_lastBatchSize, GROUP_COMMIT_MAX_FILES);
+		(void)_arrived.wait_until(lock, deadline, [this, expected]()
+		{
+			return !_running || _batch->files.size() >= expected;
+		});
+
+		// Close the batch. Files arriving during the sync round will join the next one.
+		auto batch = _batch;
+		_batch = std::make_shared<SBatch>();
+		_lastBatchSize = batch->files.size();
+		lock.unlock();
+		const auto start = std::chrono::steady_clock::now();
+		std::vector<bool> synced;
+		(void)_fileHandler.filesSync(batch->files, synced);
+		const auto syncTime = std::chrono::steady_clock::now() - start;
+		lock.lock();
+		batch->synced.swap(synced);
+		batch->syncTime = syncTime / static_cast<int64_t>(batch->files.size());
+		batch->done = true;
+		_committed.notify_all();
+	}
+}
@@ -0,0 +1,50 @@
+/**
+   Maman 14
+   @CGroupCommit batches durable file commits of concurrent requests into shared sync rounds.
+   @author Roman Koifman
+ */
+
+#pragma once
+#include "CFileHandler.h"
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CGroupCommit
+{
+#define GROUP_COMMIT_MAX_FILES  4096   // a batch is committed at once when reaching this size.
+
+    struct SBatch
+    {
+        std::vector<std::string> files;   // files waiting for this sync round.
+        std::vector<bool> synced;         // each file's result. Committers check their own files only.
+        bool done;
+        std::chrono::steady_clock::duration syncTime;   // each file's share of the sync round. Excludes the wait for files to join.
+        SBatch() : done(false), syncTime(0) {}
+    };
+
+    CFileHandler             _fileHandler;
+    std::mutex               _mutex;
+    std::condition_variable  _arrived;     // signaled when a file joins the open batch.
+    std::condition_variable  _committed;   // signaled when a batch sync round is over.
+    std::shared_ptr<SBatch>  _batch;       // open batch. files are appended to it until its sync round starts.
+    std::thread              _thread;
+    bool                     _running;
+    uint32_t                 _maxDelayMs;
+    size_t                   _lastBatchSize;
+    void run();
+
+public:
+    CGroupCommit() : _batch(std::make_shared<SBatch>()), _running(false), _maxDelayMs(0), _lastBatchSize(1) {}
+    CGroupCommit(const CGroupCommit& other) = delete;
+    CGroupCommit& operator=(const CGroupCommit& other) = delete;
+    ~CGroupCommit();
+
+    bool start(const uint32_t maxDelayMs);
+    void stop();
+    bool commit(const std::vector<std::string>& filepaths, std::chrono::steady_clock::duration& syncTime);
+};
@@ -0,0 +1,294 @@
+/**
+   Maman 14
+   @CLogger asynchronous request logger. Request threads push fixed size binary records into lock-free
+            single producer rings. A background thread formats and writes them.
+   @author Roman Koifman
+ */
+
+#include "CLogger.h"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+
+
+/**
+   The ring owned by the current thread. A thread acquires a ring on its first log record
+   and returns it for reuse when it exits, so the rings count is bounded by the concurrent threads count.
+ */
+struct SRingOwner
+{
+	CLogger* logger = nullptr;
+	CLogger::SRing* ring = nullptr;
+	~SRingOwner()
+	{
+		if (logger != nullptr && ring != nullptr)
+			logger->releaseRing(ring);
+	}
+};
+static thread_local SRingOwner ringOwner;
+
+
+CLogger::~CLogger()
+{
+	stop();
+}
+
+
+/**
+   @brief start the background writing thread.
+   @param filepath the log file to append to. If empty, log is written to std::cout.
+   @param slowUs requests lasting at least this long are logged with their phases breakdown. 0 = never.
+   @return true if started successfully. false otherwise.
+ */
+bool CLogger::start(const std::string& filepath, const uint32_t slowUs)
+{
+	if (_running)
+		return true;
+	try
+	{
+		_slowUs = slowUs;
+		_output = &std::cout;
+		if (!filepath.empty())
+		{
+			_file.open(filepath, std::ofstream::out | std::ofstream::app);
+			if (!_file.is_open())
+				return false;
+			_output = &_file;
+		}
+		_running = true;
+		_thread = std::thread(&CLogger::run, this);
+		return true;
+	}
+	catch (std::exception&)
+	{
+		_running = false;
+		return false;
+	}
+}
+
+
+/**
+   @brief stop the background writing thread. Records logged so far are written before it exits.
+ */
+void CLogger::stop()
+{
+	if (!_running.exchange(false))
+		return;
+	if (_thread.joinable())
+		_thread.join();
+	if (_file.is_open())
+		_file.close();
+}
+
+
+/**
+   @brief log a request record. Lock-free & allocation free, except for a thread's first record.
+          If the thread's ring is full, the record is dropped and counted.
+   @param record the record to log.
+ */
+void CLogger::log(const SRecord& record)
+{
+	if (!_running.load(std::memory_order_relaxed))
+		return;
+	if (ringOwner.logger != this)
+	{
+		ringOwner.ring = acquireRing();
+		ringOwner.logger = (ringOwner.ring != nullptr) ? this : nullptr;
+		if (ringOwner.ring == nullptr)
+			return;
+	}
+	SRing* const ring = ringOwner.ring;
+	const uint64_t head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) >= LOG_RING_CAPACITY)
+	{
+		(void)ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	ring->records[head & (LOG_RING_CAPACITY - 1)] = record;
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+
+/**
+   @brief describe an error code.
+ */
+const char* CLogger::describe(const uint16_t error)
+{
+	static const char* const descriptions[ERROR_COUNT] =
+	{
+		"none",
+		"exception thrown",
+		"receive from socket failed",
+		"response sending on socket failed",
+		"invalid user id",
+		"user has no files",
+		"invalid filename",
+		"file not exists",
+		"invalid request code",
+		"invalid version selector",
+		"version not exists",
+		"keeping version failed",
+		"versions listing failed",
+		"file open failed",
+		"file write failed",
+		"file read failed",
+		"file is empty",
+		"file commit failed",
+		"file deletion failed",
+		"file copy failed",
+		"file rename failed",
+		"files listing failed",
+		"payload receive failed",
+		"payload send failed"
+	};
+	return (error < ERROR_COUNT) ? descriptions[error] : "unknown error";
+}
+
+
+/**
+   @brief name a request phase.
+ */
+const char* CLogger::describePhase(const uint8_t phase)
+{
+	static const char* const names[PHASE_COUNT] =
+	{
+		"receive",
+		"lock",
+		"queue",
+		"open",
+		"transfer",
+		"commit",
+		"send"
+	};
+	return (phase < PHASE_COUNT) ? names[phase] : "unknown";
+}
+
+
+/**
+   @brief get a free ring, or create one.
+   @return the ring. nullptr if allocation failed.
+ */
+CLogger::SRing* CLogger::acquireRing()
+{
+	try
+	{
+		std::lock_guard<std::mutex> guard(_ringsMutex);
+		if (!_freeRings.empty())
+		{
+			SRing* ring = _freeRings.back();
+			_freeRings.pop_back();
+			return ring;
+		}
+		_rings.push_back(std::make_unique<SRing>());
+		return _rings.back().get();
+	}
+	catch (std::exception&)
+	{
+		return nullptr;
+	}
+}
+
+
+/**
+   @brief return a ring for reuse by other threads. Records left in it are still written.
+ */
+void CLogger::releaseRing(SRing* ring)
+{
+	try
+	{
+		std::lock_guard<std::mutex> guard(_ringsMutex);
+		_freeRings.push_back(ring);
+	}
+	catch (std::exception&)
+	{
+		// ring is leaked. It will still be drained.
+	}
+}
+
+
+/**
+   @brief write all pending records of all rings.
+   @return true if any record was written.
+ */
+bool CLogger::drain()
+{
+	std::vector<SRing*> rings;
+	{
+		std::lock_guard<std::mutex> guard(_ringsMutex);
+		rings.reserve(_rings.size());
+		for (const auto& ring : _rings)
+			rings.push_back(ring.get());
+	}
+
+	bool written = false;
+	for (auto ring : rings)
+	{
+		const uint64_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+		if (dropped != 0)
+		{
+			*_output << "Logger: " << dropped << " records dropped.\n";
+			written = true;
+		}
+
+		uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+		const uint64_t head = ring->head.load(std::memory_order_acquire);
+		if (tail == head)
+			continue;
+		for (; tail < head; ++tail)
+			write(ring->records[tail & (LOG_RING_CAPACITY - 1)]);
+		ring->tail.store(tail, std::memory_order_release);
+		written = true;
+	}
+	return written;
+}
+
+
+/**
+   @brief format a record as a single log line.
+ */
+void CLogger::write(const SRecord& record)
+{
+	const std::time_t seconds = static_cast<std::time_t>(record.timestamp / 1000000);
+	std::tm tm{};
+#if defined(_WIN32)
+	(void)gmtime_s(&tm, &seconds);
+#else
+	(void)gmtime_r(&seconds, &tm);
+#endif
+	*_output << std::put_time(&tm, "%Y-%m-%dT%H:%M:%S") << "." << std::setw(6) << std::setfill('0') << (record.timestamp % 1000000)
+		<< "Z user=" << record.userId << " op=" << +record.op << " status=" << record.status
+		<< " bytes=" << record.bytes << " us=" << record.durationUs;
+	if (record.error != ERROR_NONE)
+		*_output << " error=\"" << describe(record.error) << "\"";
+	if (_slowUs != 0 && record.durationUs >= _slowUs)
+	{
+		uint32_t other = record.durationUs;
+		*_output << " slow:";
+		for (uint8_t phase = 0; phase < PHASE_COUNT; ++phase)
+		{
+			*_output << " " << describePhase(phase) << "_us=" << record.phaseUs[phase];
+			other -= std::min(other, record.phaseUs[phase]);
+		}
+		*_output << " other_us=" << other;
+	}
+	*_output << "\n";
+}
+
+
+/**
+   @brief background thread's loop.
+ */
+void CLogger::run()
+{
+	while (_running.load(std::memory_order_relaxed))
+	{
+		if (drain())
+			_output->flush();
+		else
+			std::this_thread::sleep_for(std::chrono::milliseconds(LOG_IDLE_MS));
+	}
+	(void)drain();  // records logged before stop.
+	_output->flush();
+}
@@ -0,0 +1,102 @@
+/**
+   Maman 14
+   @CLogger asynchronous request logger. Request threads push fixed size binary records into lock-free
+            single producer rings. A background thread formats and writes them.
+   @author Roman Koifman
+ */
+
+#pragma once
+#include "Errors.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CLogger
+{
+public:
+#define LOG_RING_CAPACITY  1024   // records per ring. Must be a power of 2.
+#define LOG_IDLE_MS        10     // background thread's sleep when all rings are empty.
+
+    enum EPhase : uint8_t   // request handling phases, timed for every request.
+    {
+        PHASE_RECEIVE = 0,             // receive the request's first packet.
+        PHASE_LOCK,                    // wait for the user's previous request.
+        PHASE_QUEUE,                   // wait for the QoS scheduler to admit the request's disk accesses.
+        PHASE_OPEN,                    // open the stored file. e.g. create folders, keep a version.
+        PHASE_TRANSFER,                // transfer the payload. e.g. receive & write a backup, read & send a restore.
+        PHASE_COMMIT,                  // close a backup. durable mode: wait for its group commit.
+        PHASE_SEND,                    // send the response.
+        PHASE_COUNT
+    };
+
+    struct SRecord   // a single request's log record. Trivially copyable.
+    {
+        uint64_t timestamp;    // request start, microseconds since epoch.
+        uint32_t userId;
+        uint32_t durationUs;   // request handling duration.
+        uint32_t bytes;        // request / response payload size.
+        uint16_t status;       // response status. 0 if no response.
+        uint16_t error;        // EError.
+        uint8_t  op;           // request code.
+        uint32_t phaseUs[PHASE_COUNT];   // time spent per phase. The rest of durationUs is validation & bookkeeping.
+        SRecord() : timestamp(0), userId(0), durationUs(0), bytes(0), status(0), error(ERROR_NONE), op(0), phaseUs() {}
+
+        /**
+           @brief account the time passed since a phase started.
+           @param phase the phase which ended.
+           @param since the phase's start. Reset to now, the start of the next phase.
+           @return the phase's duration in microseconds.
+         */
+        uint32_t addPhase(const EPhase phase, std::chrono::steady_clock::time_point& since)
+        {
+            const auto now = std::chrono::steady_clock::now();
+            const auto us = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - since).count());
+            phaseUs[phase] += us;
+            since = now;
+            return us;
+        }
+    };
+
+    CLogger() : _running(false), _output(nullptr), _slowUs(0) {}
+    CLogger(const CLogger& other) = delete;
+    CLogger& operator=(const CLogger& other) = delete;
+    ~CLogger();
+
+    bool start(const std::string& filepath, const uint32_t slowUs = 0);
+    void stop();
+    void log(const SRecord& record);
+    static const char* describe(const uint16_t error);
+    static const char* describePhase(const uint8_t phase);
+
+private:
+    struct SRing   // single producer (the owning request thread), single consumer (background thread).
+    {
+        std::atomic<uint64_t> head;      // next record to write. Modified by producer only.
+        std::atomic<uint64_t> tail;      // next record to read. Modified by consumer only.
+        std::atomic<uint64_t> dropped;   // records dropped because the ring was full.
+        SRecord records[LOG_RING_CAPACITY];
+        SRing() : head(0), tail(0), dropped(0) {}
+    };
+
+    std::mutex                          _ringsMutex;  // guards ring ownership changes only. Never taken per record.
+    std::vector<std::unique_ptr<SRing>> _rings;       // all rings ever created. Rings are reused, never freed while running.
+    std::vector<SRing*>                 _freeRings;   // rings not owned by any thread.
+    std::atomic<bool>                   _running;
+    std::thread                         _thread;
+    std::ofstream                       _file;
+    std::ostream*                       _output;
+    uint32_t                            _slowUs;      // requests lasting at least this long are logged with their phases. 0 = never.
+
+    SRing* acquireRing();
+    void releaseRing(SRing* ring);
+    bool drain();
+    void write(const SRecord& record);
+    void run();
+    friend struct SRingOwner;
+};
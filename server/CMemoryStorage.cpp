@@ -0,0 +1,255 @@
+/**
+   Maman 14
+   @CMemoryStorage storage backend keeping users' files in memory. Users are sharded, each shard has its own lock.
+   @author Roman Koifman
+ */
+
+#include "CMemoryStorage.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#define MEMORY_MAX_RESERVE  (16 * 1024 * 1024)   // declared sizes are not trusted beyond this.
+
+
+static uint64_t nowMicros()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+
+CMemoryStorage::CMemoryWriteStream::CMemoryWriteStream(CMemoryStorage& storage, const uint32_t userId, const std::string& filename, const uint32_t size) :
+	_storage(storage), _userId(userId), _filename(filename)
+{
+	_data.reserve(std::min<uint32_t>(size, MEMORY_MAX_RESERVE));
+}
+
+bool CMemoryStorage::CMemoryWriteStream::write(const uint8_t* const data, const uint32_t bytes)
+{
+	try
+	{
+		if (data == nullptr || bytes == 0)
+			return false;
+		if (_storage._limit != 0 && _storage._used + _data.size() + bytes > _storage._limit)
+			return false;  // memory limit reached.
+		_data.insert(_data.end(), data, data + bytes);
+		return true;
+	}
+	catch (std::exception&)
+	{
+		return false;
+	}
+}
+
+/**
+   @brief replace the file's content. The replaced content is kept as a version if versioning is enabled.
+ */
+bool CMemoryStorage::CMemoryWriteStream::commit()
+{
+	try
+	{
+		const TContent content = _storage.store(std::move(_data));
+		auto& shard = _storage.shard(_userId);
+		std::lock_guard<std::mutex> guard(shard.mutex);
+		auto& file = shard.users[_userId][_filename];
+		if (file.content != nullptr && (_storage._keepVersions != 0 || _storage._versionMaxAgeSec != 0))
+			file.versions.push_front({ nowMicros(), file.content });
+		file.content = content;
+		_storage.prune(file);
+		return true;
+	}
+	catch (std::exception&)
+	{
+		return false;
+	}
+}
+
+
+bool CMemoryStorage::CMemoryReadStream::read(uint8_t* const data, const uint32_t bytes)
+{
+	if (data == nullptr || bytes == 0)
+		return false;
+	const size_t length = std::min<size_t>(bytes, _content->size() - _offset);
+	memcpy(data, _content->data() + _offset, length);
+	memset(data + length, 0, bytes - length);
+	_offset += length;
+	return true;
+}
+
+
+/**
+   @brief configure versions retention and memory limit.
+   @param config the server settings.
+   @param err description error. applicable only if function returns false.
+   @return true if initialized successfully. false otherwise.
+ */
+bool CMemoryStorage::initialize(const CServerConfig& config, std::stringstream& err)
+{
+	(void)err;
+	_keepVersions = config.keepVersions;
+	_versionMaxAgeSec = config.versionMaxAgeSec;
+	_limit = config.memoryLimitMb * 1024 * 1024;
+	return true;
+}
+
+
+/**
+   @brief make a shared immutable content. Memory usage is accounted until the last reference is released.
+ */
+CMemoryStorage::TContent CMemoryStorage::store(std::vector<uint8_t>&& data)
+{
+	const uint64_t size = data.size();
+	_used += size;
+	return TContent(new std::vector<uint8_t>(std::move(data)), [this, size](const std::vector<uint8_t>* p)
+	{
+		_used -= size;
+		delete p;
+	});
+}
+
+
+/**
+   @brief remove versions exceeding the retention policy. The shard should be locked.
+ */
+void CMemoryStorage::prune(SFile& file) const
+{
+	const uint64_t now = nowMicros();
+	while (!file.versions.empty())
+	{
+		const bool tooMany = (_keepVersions != 0 && file.versions.size() > _keepVersions);
+		const bool tooOld = (_versionMaxAgeSec != 0 && file.versions.back().stamp + _versionMaxAgeSec * 1000000 < now);
+		if (!tooMany && !tooOld)
+			break;
+		file.versions.pop_back();
+	}
+}
+
+
+std::unique_ptr<CStorage::CWriteStream> CMemoryStorage::put(const uint32_t userId, const std::string& filename, const uint32_t size, EError& error)
+{
+	if (_limit != 0 && _used + size > _limit)
+	{
+		error = ERROR_FILE_OPEN;   // memory limit reached.
+		return nullptr;
+	}
+	return std::make_unique<CMemoryWriteStream>(*this, userId, filename, size);
+}
+
+
+std::unique_ptr<CStorage::CReadStream> CMemoryStorage::get(const uint32_t userId, const std::string& filename, const uint32_t version, EError& error)
+{
+	auto& shard = this->shard(userId);
+	std::lock_guard<std::mutex> guard(shard.mutex);
+	const auto user = shard.users.find(userId);
+	if (user == shard.users.end() || user->second.find(filename) == user->second.end())
+	{
+		error = ERROR_NOT_EXIST;
+		return nullptr;
+	}
+	auto& file = user->second[filename];
+	if (version == 0)
+		return std::make_unique<CMemoryReadStream>(file.content);
+	prune(file);
+	if (version > file.versions.size())
+	{
+		error = ERROR_VERSION_NOT_EXIST;
+		return nullptr;
+	}
+	return std::make_unique<CMemoryReadStream>(file.versions[version - 1].content);
+}
+
+
+bool CMemoryStorage::remove(const uint32_t userId, const std::string& filename)
+{
+	auto& shard = this->shard(userId);
+	std::lock_guard<std::mutex> guard(shard.mutex);
+	const auto user = shard.users.find(userId);
+	if (user == shard.users.end() || user->second.erase(filename) == 0)
+		return false;
+	if (user->second.empty())
+		shard.users.erase(user);
+	return true;
+}
+
+
+/**
+   @brief copy or rename a file within a user's files. Contents are immutable, hence shared rather than copied.
+   @param move rename if true. copy otherwise.
+ */
+bool CMemoryStorage::relocate(const uint32_t userId, const std::string& source, const std::string& destination, const bool move, EError& error)
+{
+	auto& shard = this->shard(userId);
+	std::lock_guard<std::mutex> guard(shard.mutex);
+	const auto user = shard.users.find(userId);
+	if (user == shard.users.end() || user->second.find(source) == user->second.end())
+	{
+		error = ERROR_NOT_EXIST;
+		return false;
+	}
+	if (source == destination)
+		return true;
+	const TContent content = user->second[source].content;
+	auto& file = user->second[destination];
+	if (file.content != nullptr && (_keepVersions != 0 || _versionMaxAgeSec != 0))
+		file.versions.push_front({ nowMicros(), file.content });
+	file.content = content;
+	if (move)
+	{
+		const auto& versions = user->second[source].versions;   // the renamed file's versions move with it.
+		file.versions.insert(file.versions.end(), versions.begin(), versions.end());
+		std::stable_sort(file.versions.begin(), file.versions.end(), [](const SVersion& a, const SVersion& b) { return a.stamp > b.stamp; });
+		user->second.erase(source);
+	}
+	prune(file);
+	return true;
+}
+
+bool CMemoryStorage::copy(const uint32_t userId, const std::string& source, const std::string& destination, EError& error)
+{
+	return relocate(userId, source, destination, false, error);
+}
+
+bool CMemoryStorage::rename(const uint32_t userId, const std::string& source, const std::string& destination, EError& error)
+{
+	return relocate(userId, source, destination, true, error);
+}
+
+
+bool CMemoryStorage::list(const uint32_t userId, std::set<std::string>& files)
+{
+	auto& shard = this->shard(userId);
+	std::lock_guard<std::mutex> guard(shard.mutex);
+	const auto user = shard.users.find(userId);
+	if (user == shard.users.end())
+		return true;
+	for (const auto& file : user->second)
+		files.insert(file.first);
+	return true;
+}
+
+
+bool CMemoryStorage::versions(const uint32_t userId, const std::string& filename, uint32_t& count)
+{
+	count = 0;
+	auto& shard = this->shard(userId);
+	std::lock_guard<std::mutex> guard(shard.mutex);
+	const auto user = shard.users.find(userId);
+	if (user == shard.users.end())
+		return false;
+	const auto file = user->second.find(filename);
+	if (file == user->second.end())
+		return false;
+	prune(file->second);
+	count = static_cast<uint32_t>(file->second.versions.size());
+	return true;
+}
+
+
+bool CMemoryStorage::exists(const uint32_t userId, const std::string& filename)
+{
+	auto& shard = this->shard(userId);
+	std::lock_guard<std::mutex> guard(shard.mutex);
+	const auto user = shard.users.find(userId);
+	return (user != shard.users.end() && user->second.find(filename) != user->second.end());
+}
@@ -0,0 +1,88 @@
+/**
+   Maman 14
+   @CMemoryStorage storage backend keeping users' files in memory. Users are sharded, each shard has its own lock.
+   @author Roman Koifman
+ */
+
+#pragma once
+#include "CStorage.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class CMemoryStorage : public CStorage
+{
+#define MEMORY_SHARDS  64
+
+    typedef std::shared_ptr<const std::vector<uint8_t>> TContent;   // shared by readers, never modified.
+
+    struct SVersion
+    {
+        uint64_t stamp;     // microseconds since epoch when replaced.
+        TContent content;
+    };
+
+    struct SFile
+    {
+        TContent content;
+        std::deque<SVersion> versions;   // newest first.
+    };
+
+    struct SShard
+    {
+        std::mutex mutex;
+        std::unordered_map<uint32_t, std::map<std::string, SFile>> users;
+    };
+
+    class CMemoryWriteStream : public CWriteStream
+    {
+        CMemoryStorage&      _storage;
+        uint32_t             _userId;
+        std::string          _filename;
+        std::vector<uint8_t> _data;
+    public:
+        CMemoryWriteStream(CMemoryStorage& storage, const uint32_t userId, const std::string& filename, const uint32_t size);
+        bool write(const uint8_t* const data, const uint32_t bytes) override;
+        bool commit() override;
+    };
+
+    class CMemoryReadStream : public CReadStream
+    {
+        TContent _content;
+        size_t   _offset;
+    public:
+        explicit CMemoryReadStream(const TContent& content) : _content(content), _offset(0) {}
+        uint32_t size() const override { return static_cast<uint32_t>(_content->size()); }
+        bool read(uint8_t* const data, const uint32_t bytes) override;
+        bool seek(const uint32_t offset) override { _offset = std::min<size_t>(offset, _content->size()); return true; }
+    };
+
+    SShard                _shards[MEMORY_SHARDS];
+    uint32_t              _keepVersions;
+    uint64_t              _versionMaxAgeSec;
+    uint64_t              _limit;     // bytes. 0 = unlimited.
+    std::atomic<uint64_t> _used;      // bytes of all contents, including versions.
+
+    SShard& shard(const uint32_t userId) { return _shards[userId % MEMORY_SHARDS]; }
+    void prune(SFile& file) const;
+    TContent store(std::vector<uint8_t>&& data);
+    bool relocate(const uint32_t userId, const std::string& source, const std::string& destination, const bool move, EError& error);
+
+public:
+    CMemoryStorage() : _keepVersions(0), _versionMaxAgeSec(0), _limit(0), _used(0) {}
+    bool initialize(const CServerConfig& config, std::stringstream& err) override;
+    void shutdown() override {}
+
+    std::unique_ptr<CWriteStream> put(const uint32_t userId, const std::string& filename, const uint32_t size, EError& error) override;
+    std::unique_ptr<CReadStream> get(const uint32_t userId, const std::string& filename, const uint32_t version, EError& error) override;
+    bool remove(const uint32_t userId, const std::string& filename) override;
+    bool copy(const uint32_t userId, const std::string& source, const std::string& destination, EError& error) override;
+    bool rename(const uint32_t userId, const std::string& source, const std::string& destination, EError& error) override;
+    bool list(const uint32_t userId, std::set<std::string>& files) override;
+    bool versions(const uint32_t userId, const std::string& filename, uint32_t& count) override;
+    bool exists(const uint32_t userId, const std::string& filename) override;
+};
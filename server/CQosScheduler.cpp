@@ -0,0 +1,160 @@
+/**
+   Maman 14
+   @CQosScheduler admits requests' disk accesses by priority class, limiting how many run at once.
+   @author Roman Koifman
+ */
+
+#include "CQosScheduler.h"
+#include "Protocol.h"
+#include <algorithm>
+
+
+/**
+   @brief set concurrency limits & class weights. Should be called before requests are admitted.
+   @param maxActive concurrent disk accesses of all classes. 0 = unlimited.
+   @param limits concurrent disk accesses per class. 0 = bounded by maxActive only.
+   @param weights share of the transferred bytes per class, relative to the other backlogged classes. 0 is taken as 1.
+ */
+void CQosScheduler::configure(const uint32_t maxActive, const uint32_t (&limits)[CLASS_COUNT], const uint32_t (&weights)[CLASS_COUNT])
+{
+	std::lock_guard<std::mutex> guard(_mutex);
+	_maxActive = maxActive;
+	for (size_t i = 0; i < CLASS_COUNT; ++i)
+	{
+		_classes[i].limit = limits[i];
+		_classes[i].weight = std::max<uint32_t>(weights[i], 1);
+	}
+}
+
+
+/**
+   @brief the priority class of a request code.
+ */
+CQosScheduler::EClass CQosScheduler::classify(const uint8_t op)
+{
+	if (op == SRequest::FILE_RESTORE || op == SRequest::FILE_RESTORE_ALL)
+		return CLASS_RESTORE;
+	if (op == SRequest::FILE_BACKUP)
+		return CLASS_BACKUP;
+	return CLASS_DIR;
+}
+
+
+/**
+   @brief total time the request's accesses waited for admission, in microseconds.
+ */
+uint32_t CQosScheduler::CAdmission::waitedUs() const
+{
+	return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(_waited).count());
+}
+
+
+/**
+   @brief wait for a disk access to be admitted.
+   @param admission the request accessing the disk.
+   @param since the start of the request's phase the access belongs to. Moved forward by the wait for admission,
+          so that the phase excludes it.
+ */
+CQosScheduler::CAccess::CAccess(CAdmission& admission, std::chrono::steady_clock::time_point& since) : _admission(admission), _bytes(0)
+{
+	const auto start = std::chrono::steady_clock::now();
+	_admission._scheduler.admit(_admission._cls, _admission._userId, _admission._cost);
+	_admission._cost = 0;
+	const auto waited = std::chrono::steady_clock::now() - start;
+	_admission._waited += waited;
+	since += waited;
+}
+
+
+/**
+   @brief block until a disk access may start. Must be followed by release() once it is over.
+   @param cls the request's class.
+   @param userId the request's user.
+   @param cost bytes charged on admission, e.g. for the request's metadata I/O.
+ */
+void CQosScheduler::admit(const EClass cls, const uint32_t userId, const uint64_t cost)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	SWaiter waiter = { userId, cost, false };
+	_classes[cls].waiting.push_back(&waiter);
+	dispatch();
+	_admitted.wait(lock, [&waiter]() { return waiter.admitted; });
+}
+
+
+/**
+   @brief a disk access admitted by admit() is over. Its transferred bytes are charged to its class & user,
+          delaying their next accesses in favor of the others.
+   @param cls the request's class.
+   @param userId the request's user.
+   @param bytes payload bytes the access transferred.
+ */
+void CQosScheduler::release(const EClass cls, const uint32_t userId, const uint64_t bytes)
+{
+	std::lock_guard<std::mutex> guard(_mutex);
+	SClass& scheduled = _classes[cls];
+	--_active;
+	--scheduled.active;
+	scheduled.finish += static_cast<double>(bytes) / scheduled.weight;
+	scheduled.userFinish[userId] += static_cast<double>(bytes);
+	if (scheduled.userFinish.size() > QOS_MAX_IDLE_USERS)
+	{
+		for (auto it = scheduled.userFinish.begin(); it != scheduled.userFinish.end();)   // behind the class' virtual time is as good as unknown.
+			it = (it->second <= scheduled.vtime) ? scheduled.userFinish.erase(it) : std::next(it);
+	}
+	dispatch();
+}
+
+
+/**
+   @brief admit waiting accesses while capacity allows. Picks the class with the earliest start tag (ties by priority),
+          then its user with the earliest start tag (ties by arrival). Must be called with _mutex held.
+ */
+void CQosScheduler::dispatch()
+{
+	bool admitted = false;
+	while (_maxActive == 0 || _active < _maxActive)
+	{
+		SClass* next = nullptr;
+		double nextStart = 0;
+		for (auto& candidate : _classes)
+		{
+			if (candidate.waiting.empty() || (candidate.limit != 0 && candidate.active >= candidate.limit))
+				continue;
+			const double start = std::max(_vtime, candidate.finish);
+			if (next == nullptr || start < nextStart)
+			{
+				next = &candidate;
+				nextStart = start;
+			}
+		}
+		if (next == nullptr)
+			break;
+
+		auto chosen = next->waiting.begin();
+		double userStart = 0;
+		for (auto it = next->waiting.begin(); it != next->waiting.end(); ++it)
+		{
+			const auto finish = next->userFinish.find((*it)->userId);
+			const double start = std::max(next->vtime, (finish == next->userFinish.end()) ? 0 : finish->second);
+			if (it == next->waiting.begin() || start < userStart)
+			{
+				chosen = it;
+				userStart = start;
+			}
+		}
+
+		SWaiter* waiter = *chosen;
+		next->waiting.erase(chosen);
+		_vtime = nextStart;
+		next->finish = nextStart + (static_cast<double>(waiter->cost) / next->weight);
+		next->vtime = userStart;
+		next->userFinish[waiter->userId] = userStart + static_cast<double>(waiter->cost);
+		++next->active;
+		++_active;
+		waiter->admitted = true;
+		admitted = true;
+	}
+	if (admitted)
+		_admitted.notify_all();
+}
@@ -0,0 +1,102 @@
+/**
+   Maman 14
+   @CQosScheduler admits requests' disk accesses by priority class (restore, dir, backup), limiting how many run at once.
+           A request holds a slot only while it accesses storage (e.g. opening, writing a received chunk, committing),
+           never while it waits on its client's network. Waiting accesses are admitted by start-time fair queuing over
+           the bytes they transfer: weighted between classes, then equally between the users of a class.
+   @author Roman Koifman
+ */
+
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+class CQosScheduler
+{
+#define QOS_REQUEST_COST       4096   // bytes charged per request on its first access, for its metadata I/O. Transferred bytes are charged per access.
+#define QOS_MAX_IDLE_USERS     4096   // users' tags kept per class before the idle ones are dropped.
+public:
+    enum EClass
+    {
+        CLASS_RESTORE = 0,   // FILE_RESTORE, FILE_RESTORE_ALL. Interactive, highest priority.
+        CLASS_DIR,           // FILE_DIR, FILE_REMOVE, FILE_COPY, FILE_RENAME & invalid requests. Metadata only.
+        CLASS_BACKUP,        // FILE_BACKUP. Bulk.
+        CLASS_COUNT
+    };
+
+private:
+    struct SWaiter
+    {
+        uint32_t userId;
+        uint64_t cost;        // bytes charged on admission.
+        bool     admitted;
+    };
+
+    struct SClass
+    {
+        uint32_t weight;
+        uint32_t limit;       // concurrent disk accesses. 0 = bounded by _maxActive only.
+        uint32_t active;
+        double   finish;      // finish tag of the class' last admitted request, in scheduler virtual time.
+        double   vtime;       // start tag of the class' last admitted request, in class virtual time.
+        std::unordered_map<uint32_t, double> userFinish;   // finish tag of each user's last admitted request, in class virtual time.
+        std::deque<SWaiter*> waiting;                     // arrival order. a user has at most one waiting access.
+        SClass() : weight(1), limit(0), active(0), finish(0), vtime(0) {}
+    };
+
+    std::mutex              _mutex;
+    std::condition_variable _admitted;
+    SClass                  _classes[CLASS_COUNT];
+    uint32_t                _maxActive;   // 0 = unlimited.
+    uint32_t                _active;
+    double                  _vtime;       // start tag of the last admitted request.
+
+    void dispatch();
+
+public:
+    CQosScheduler() : _maxActive(0), _active(0), _vtime(0) {}
+    CQosScheduler(const CQosScheduler& other) = delete;
+    CQosScheduler& operator=(const CQosScheduler& other) = delete;
+
+    class CAccess;
+
+    // a request's standing with the scheduler. Its disk accesses are admitted one by one (CAccess).
+    class CAdmission
+    {
+        friend class CQosScheduler::CAccess;
+        CQosScheduler& _scheduler;
+        EClass         _cls;
+        uint32_t       _userId;
+        uint64_t       _cost;     // charged on the next access's admission. The request's cost until its first access.
+        std::chrono::steady_clock::duration _waited;   // waiting for admission, all accesses.
+    public:
+        CAdmission(CQosScheduler& scheduler, const EClass cls, const uint32_t userId) :
+            _scheduler(scheduler), _cls(cls), _userId(userId), _cost(QOS_REQUEST_COST), _waited(0) {}
+        CAdmission(const CAdmission& other) = delete;
+        CAdmission& operator=(const CAdmission& other) = delete;
+        EClass cls() const { return _cls; }
+        uint32_t waitedUs() const;
+    };
+
+    // a single disk access of a request, from its admission until it is released on destruction, even if handling throws.
+    class CAccess
+    {
+        CAdmission& _admission;
+        uint64_t    _bytes;   // charged on release.
+    public:
+        CAccess(CAdmission& admission, std::chrono::steady_clock::time_point& since);
+        ~CAccess() { _admission._scheduler.release(_admission._cls, _admission._userId, _bytes); }
+        CAccess(const CAccess& other) = delete;
+        CAccess& operator=(const CAccess& other) = delete;
+        void charge(const uint64_t bytes) { _bytes += bytes; }
+    };
+
+    void configure(const uint32_t maxActive, const uint32_t (&limits)[CLASS_COUNT], const uint32_t (&weights)[CLASS_COUNT]);
+    static EClass classify(const uint8_t op);
+    void admit(const EClass cls, const uint32_t userId, const uint64_t cost);
+    void release(const EClass cls, const uint32_t userId, const uint64_t bytes);
+};
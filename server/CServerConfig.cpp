@@ -0,0 +1,264 @@
+/**
+   Maman 14
+   @CServerConfig holds the server settings given on the command line.
+   @author Roman Koifman
+ */
+
+#include "CServerConfig.h"
+#include <limits>
+
+
+/**
+   @brief parse an unsigned numeric option value.
+   @param value the string to parse.
+   @param max maximal allowed value.
+   @param result the parsed value will be saved in this object.
+   @return true if value was parsed successfully.
+ */
+static bool parseNumber(const std::string& value, const uint64_t max, uint64_t& result)
+{
+	if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+		return false;
+	try
+	{
+		result = std::stoull(value);
+		return (result <= max);
+	}
+	catch (std::exception&)
+	{
+		return false;
+	}
+}
+
+
+/**
+   @brief parse command line arguments. Unspecified settings keep their default values.
+   @param argc arguments count.
+   @param argv arguments array. argv[0] is the program name.
+   @param err description error. applicable only if function returns false.
+   @return true if all arguments were parsed successfully. false, otherwise.
+ */
+bool CServerConfig::parse(const int argc, char* argv[], std::stringstream& err)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string option(argv[i]);
+		std::string value;
+		uint64_t number = 0;
+		auto nextValue = [&]() -> bool
+		{
+			if (i + 1 >= argc)
+			{
+				err << "Missing value for option " << option << std::endl;
+				return false;
+			}
+			value = argv[++i];
+			return true;
+		};
+
+		if (option == "--durable")
+		{
+			durable = true;
+		}
+		else if (option == "--trace-hashes")
+		{
+			traceHashes = true;
+		}
+		else if (option == "--port")
+		{
+			if (!nextValue())
+				return false;
+			if (!parseNumber(value, std::numeric_limits<uint16_t>::max(), number) || number == 0)
+			{
+				err << "Invalid port: " << value << std::endl;
+				return false;
+			}
+			port = static_cast<uint16_t>(number);
+		}
+		else if (option == "--storage")
+		{
+			if (!nextValue())
+				return false;
+			if (value != "file" && value != "memory")
+			{
+				err << "Invalid storage: " << value << std::endl;
+				return false;
+			}
+			storage = (value == "memory") ? STORAGE_MEMORY : STORAGE_FILE;
+		}
+		else if (option == "--memory-limit-mb")
+		{
+			if (!nextValue())
+				return false;
+			if (!parseNumber(value, std::numeric_limits<uint32_t>::max(), number))
+			{
+				err << "Invalid memory limit: " << value << std::endl;
+				return false;
+			}
+			memoryLimitMb = number;
+		}
+		else if (option == "--root")
+		{
+			if (!nextValue())
+				return false;
+			roots.push_back(value);
+		}
+		else if (option == "--placement")
+		{
+			if (!nextValue())
+				return false;
+			if (value != "user" && value != "file")
+			{
+				err << "Invalid placement: " << value << std::endl;
+				return false;
+			}
+			placePerFile = (value == "file");
+		}
+		else if (option == "--commit-delay-ms")
+		{
+			if (!nextValue())
+				return false;
+			if (!parseNumber(value, std::numeric_limits<uint32_t>::max(), number))
+			{
+				err << "Invalid commit delay: " << value << std::endl;
+				return false;
+			}
+			commitDelayMs = static_cast<uint32_t>(number);
+		}
+		else if (option == "--keep-versions")
+		{
+			if (!nextValue())
+				return false;
+			if (!parseNumber(value, std::numeric_limits<uint32_t>::max(), number))
+			{
+				err << "Invalid versions count: " << value << std::endl;
+				return false;
+			}
+			keepVersions = static_cast<uint32_t>(number);
+		}
+		else if (option == "--version-max-age-sec")
+		{
+			if (!nextValue())
+				return false;
+			if (!parseNumber(value, std::numeric_limits<uint32_t>::max(), number))
+			{
+				err << "Invalid version age: " << value << std::endl;
+				return false;
+			}
+			versionMaxAgeSec = number;
+		}
+		else if (option == "--slow-ms")
+		{
+			if (!nextValue())
+				return false;
+			if (!parseNumber(value, std::numeric_limits<uint32_t>::max() / 1000, number))
+			{
+				err << "Invalid slow request threshold: " << value << std::endl;
+				return false;
+			}
+			slowMs = static_cast<uint32_t>(number);
+		}
+		else if (option == "--max-active" || option == "--max-restores" || option == "--max-dirs" || option == "--max-backups")
+		{
+			if (!nextValue())
+				return false;
+			if (!parseNumber(value, std::numeric_limits<uint32_t>::max(), number))
+			{
+				err << "Invalid concurrency limit: " << value << std::endl;
+				return false;
+			}
+			uint32_t& limit = (option == "--max-active") ? maxActive : (option == "--max-restores") ? maxRestores :
+				(option == "--max-dirs") ? maxDirs : maxBackups;
+			limit = static_cast<uint32_t>(number);
+		}
+		else if (option == "--qos-weights")
+		{
+			if (!nextValue())
+				return false;
+			uint32_t* const weights[] = { &weightRestore, &weightDir, &weightBackup };
+			std::stringstream ss(value);
+			std::string weight;
+			size_t count = 0;
+			while (std::getline(ss, weight, ','))
+			{
+				if (count >= 3 || !parseNumber(weight, std::numeric_limits<uint16_t>::max(), number) || number == 0)
+				{
+					count = 0;
+					break;
+				}
+				*weights[count++] = static_cast<uint32_t>(number);
+			}
+			if (count != 3)
+			{
+				err << "Invalid QoS weights: " << value << std::endl;
+				return false;
+			}
+		}
+		else if (option == "--fault-disk-latency-us" || option == "--fault-disk-jitter-us" || option == "--fault-disk-error-permille")
+		{
+			if (!nextValue())
+				return false;
+			const bool errors = (option == "--fault-disk-error-permille");
+			if (!parseNumber(value, errors ? 1000 : std::numeric_limits<uint32_t>::max(), number))
+			{
+				err << "Invalid injected fault: " << value << std::endl;
+				return false;
+			}
+			uint32_t& fault = errors ? faultDiskErrorPermille : (option == "--fault-disk-latency-us") ? faultDiskLatencyUs : faultDiskJitterUs;
+			fault = static_cast<uint32_t>(number);
+		}
+		else if (option == "--log")
+		{
+			if (!nextValue())
+				return false;
+			logFile = value;
+		}
+		else if (option == "--trace")
+		{
+			if (!nextValue())
+				return false;
+			traceFile = value;
+		}
+		else
+		{
+			err << "Unknown option: " << option << std::endl;
+			return false;
+		}
+	}
+	if (roots.empty())
+		roots.push_back(DEFAULT_BACKUP_FOLDER);
+	return true;
+}
+
+
+/**
+   @brief describe the supported command line options.
+   @param program the program name.
+   @return usage string.
+ */
+std::string CServerConfig::usage(const std::string& program)
+{
+	std::stringstream ss;
+	ss << "Usage: " << program << " [options]" << std::endl
+	   << "  --port N             listening port (default " << DEFAULT_PORT << ")." << std::endl
+	   << "  --storage TYPE       'file' stores files under backup folders, 'memory' in RAM (default file)." << std::endl
+	   << "  --memory-limit-mb N  memory storage: maximal stored MB, including versions (default unlimited)." << std::endl
+	   << "  --root PATH          backup folder. Repeat once per disk (default " << DEFAULT_BACKUP_FOLDER << ")." << std::endl
+	   << "  --placement MODE     'user' places all files of a user on one root, 'file' each file (default user)." << std::endl
+	   << "  --durable            answer FILE_BACKUP only after the file is on stable storage." << std::endl
+	   << "  --commit-delay-ms N  durable mode: maximum group commit delay (default " << DEFAULT_COMMIT_DELAY_MS << ")." << std::endl
+	   << "  --keep-versions N    keep up to N previous versions of each file." << std::endl
+	   << "  --version-max-age-sec N  keep previous versions for up to N seconds." << std::endl
+	   << "  --max-active N       up to N requests access the disk at once, 0 = unlimited (default " << DEFAULT_MAX_ACTIVE << ")." << std::endl
+	   << "  --max-restores N / --max-dirs N / --max-backups N  per class limits within max-active, 0 = none" << std::endl
+	   << "                       (default none / none / " << DEFAULT_MAX_BACKUPS << ")." << std::endl
+	   << "  --qos-weights R,D,B  shares of transferred bytes of restores, dirs & backups (default "
+	   << DEFAULT_WEIGHT_RESTORE << "," << DEFAULT_WEIGHT_DIR << "," << DEFAULT_WEIGHT_BACKUP << ")." << std::endl
+	   << "  --log FILE           append the requests log to FILE (default: standard output)." << std::endl
+	   << "  --slow-ms N          log the phases breakdown of requests lasting at least N ms." << std::endl
+	   << "  --trace FILE         record a binary trace of incoming requests to FILE." << std::endl
+	   << "  --trace-hashes       record payload hashes in the trace." << std::endl
+	   << "  --fault-disk-latency-us N / --fault-disk-jitter-us N / --fault-disk-error-permille N" << std::endl
+	   << "                       testing: delay file system calls by N us plus up to N us of jitter, fail N per 1000." << std::endl;
+	return ss.str();
+}
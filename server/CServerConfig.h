@@ -0,0 +1,62 @@
+/**
+   Maman 14
+   @CServerConfig holds the server settings given on the command line.
+   @author Roman Koifman
+ */
+
+#pragma once
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+class CServerConfig
+{
+public:
+#define DEFAULT_PORT             8080
+#define DEFAULT_BACKUP_FOLDER    "c:/backupsvr/"
+#define DEFAULT_COMMIT_DELAY_MS  5      // maximum time a group commit waits for more files to join.
+#define DEFAULT_MAX_ACTIVE       16     // concurrent disk accesses. Slots are held during disk accesses only, never on the network.
+#define DEFAULT_MAX_BACKUPS      12     // concurrent disk accesses of backups. Leaves restores & dirs slots under bulk backups.
+#define DEFAULT_WEIGHT_RESTORE   8      // QoS shares of transferred bytes: restore : dir : backup.
+#define DEFAULT_WEIGHT_DIR       4
+#define DEFAULT_WEIGHT_BACKUP    1
+
+    enum EStorage
+    {
+        STORAGE_FILE,     // files on the file system, under roots.
+        STORAGE_MEMORY    // files in memory. Lost when the server exits.
+    };
+
+    uint16_t port;
+    EStorage storage;
+    std::vector<std::string> roots;  // backup folders, one per disk. Defaults to DEFAULT_BACKUP_FOLDER.
+    bool     placePerFile;      // place each file independently across roots, instead of each user.
+    bool     durable;           // FILE_BACKUP is answered only once data & directory entry are on stable storage.
+    uint32_t commitDelayMs;     // durable mode: maximum delay of a group commit.
+    uint32_t keepVersions;      // previous versions kept per file. 0 = no count limit.
+    uint64_t versionMaxAgeSec;  // previous versions older than this are removed. 0 = no age limit.
+    uint64_t memoryLimitMb;     // memory storage: maximal stored bytes, including versions. 0 = unlimited.
+    std::string logFile;        // requests log. empty = std::cout.
+    std::string traceFile;      // requests trace to record. empty = no recording.
+    bool     traceHashes;       // record payload hashes in trace.
+    uint32_t slowMs;            // requests lasting at least this long are logged with their phases breakdown. 0 = never.
+    uint32_t maxActive;         // concurrent disk accesses of all requests. 0 = unlimited.
+    uint32_t maxRestores;       // concurrent disk accesses of FILE_RESTORE | FILE_RESTORE_ALL requests. 0 = bounded by maxActive only.
+    uint32_t maxDirs;           // concurrent disk accesses of FILE_DIR | FILE_REMOVE | FILE_COPY | FILE_RENAME requests. 0 = bounded by maxActive only.
+    uint32_t maxBackups;        // concurrent disk accesses of FILE_BACKUP requests. 0 = bounded by maxActive only.
+    uint32_t weightRestore;     // QoS weights: share of transferred bytes per class while classes compete.
+    uint32_t weightDir;
+    uint32_t weightBackup;
+    uint32_t faultDiskLatencyUs;      // testing: latency added to each file system call.
+    uint32_t faultDiskJitterUs;       // testing: random latency added on top, up to this.
+    uint32_t faultDiskErrorPermille;  // testing: file system calls failing, per 1000.
+
+    CServerConfig() : port(DEFAULT_PORT), storage(STORAGE_FILE), placePerFile(false), durable(false), commitDelayMs(DEFAULT_COMMIT_DELAY_MS),
+        keepVersions(0), versionMaxAgeSec(0), memoryLimitMb(0), traceHashes(false), slowMs(0),
+        maxActive(DEFAULT_MAX_ACTIVE), maxRestores(0), maxDirs(0), maxBackups(DEFAULT_MAX_BACKUPS),
+        weightRestore(DEFAULT_WEIGHT_RESTORE), weightDir(DEFAULT_WEIGHT_DIR), weightBackup(DEFAULT_WEIGHT_BACKUP),
+        faultDiskLatencyUs(0), faultDiskJitterUs(0), faultDiskErrorPermille(0) {}
+    bool parse(const int argc, char* argv[], std::stringstream& err);
+    static std::string usage(const std::string& program);
+};
@@ -5,10 +5,12 @@
  */
 
 #include "CServerLogic.h"
+#include "CFaultInjector.h"
+#include "Probes.h"
 #include <sstream> 
 #include <algorithm>
+#include <chrono>
 #include <fstream>
-#include <thread>
 
 /**
    @brief generate a random string of given length.
@@ -40,12 +42,8 @@ bool CServerLogic::userHasFiles(const uint32_t userId)
 {
 	if (userId == 0)
 		return false;
-	std::stringstream ss;
-	ss << BACKUP_FOLDER << userId;
-	auto userFolder = ss.str();
 	std::set<std::string> userFiles;
-
-	if (!_fileHandler.getFilesList(userFolder, userFiles))
+	if (!_storage->list(userId, userFiles))
 		return false;
 	return (!userFiles.empty());
 }
@@ -77,6 +75,33 @@ bool CServerLogic::parseFilename(const uint16_t filenameLength, const uint8_t* f
 	return true;
 }
 
+/**
+   @brief check that a client supplied name is a single path component, so it can't reach outside the user's files.
+   @param name a parsed filename, copy / rename destination or restore prefix.
+   @return true if name is non empty, has no path separators and is not a dot component. false otherwise.
+ */
+bool CServerLogic::isPlainName(const std::string& name)
+{
+	return (!name.empty() && name != "." && name != ".." && name.find_first_of("/\\") == std::string::npos);
+}
+
+/**
+   @brief parse the optional version selector of a request. The selector is passed as a 4 bytes payload.
+   @param request the request to parse.
+   @param selector the parsed selector will be saved in this object. 0 if request has no payload.
+   @return true if selector was parsed successfully.
+ */
+bool CServerLogic::parseSelector(const SRequest& request, uint32_t& selector)
+{
+	selector = 0;
+	if (request.payload.size == 0)
+		return true;
+	if (request.payload.size != sizeof(selector) || request.payload.payload == nullptr)
+		return false;
+	memcpy(&selector, request.payload.payload, sizeof(selector));
+	return true;
+}
+
 /***
    @brief Copy a filename from request to response. the calling function is responsible for freeing the allocated memory.
    @param request the source of the filename
@@ -93,56 +118,167 @@ void CServerLogic::copyFilename(const SRequest& request, SResponse& response)
 
 
 /**
-   @brief thread's entry point function.
-   @param sock the socket a client connected to.
-   @param err description error string stream for debugging.
-   @return true if operation succeeded. false otherwise.
+   @brief apply server settings. Should be called once, before handling any socket.
+   @param config the server settings.
+   @param err description error. applicable only if function returns false.
+   @return true if initialized successfully. false otherwise.
  */
-bool CServerLogic::handleSocketFromThread(boost::asio::ip::tcp::socket& sock, std::stringstream& err)
+bool CServerLogic::initialize(const CServerConfig& config, std::stringstream& err)
 {
-	try
+	CFaultInjector::configure(config.faultDiskLatencyUs, config.faultDiskJitterUs, config.faultDiskErrorPermille);
+	_storage = CStorage::create(config, err);
+	if (_storage == nullptr)
+		return false;
+	if (!_logger.start(config.logFile, config.slowMs * 1000))
+	{
+		err << "CServerLogic::initialize: Failed to start logger!" << std::endl;
+		return false;
+	}
+	if (!config.traceFile.empty() && !_tracer.start(config.traceFile, config.traceHashes))
 	{
-		uint8_t buffer[PACKET_SIZE];
-		SRequest* request = nullptr;    // allocated in deserializeRequest()
-		SResponse* response = nullptr;  // allocated in handleRequest()
-		bool responseSent = false;      // response was sent ?
+		err << "CServerLogic::initialize: Failed to create trace file " << config.traceFile << std::endl;
+		return false;
+	}
+	const uint32_t limits[CQosScheduler::CLASS_COUNT] = { config.maxRestores, config.maxDirs, config.maxBackups };
+	const uint32_t weights[CQosScheduler::CLASS_COUNT] = { config.weightRestore, config.weightDir, config.weightBackup };
+	_scheduler.configure(config.maxActive, limits, weights);
+	return true;
+}
 
-		if (!_socketHandler.receive(sock, buffer))
+
+/**
+   @brief flush & stop background services: storage, trace and log.
+          Should be called once, when the server exits.
+ */
+void CServerLogic::shutdown()
+{
+	if (_storage != nullptr)
+		_storage->shutdown();
+	_tracer.stop();
+	_logger.stop();
+}
+
+
+/**
+   @brief thread's entry point function. Each request is logged asynchronously once handled.
+          Persistent clients (version >= CLIENT_VERSION_PERSISTENT) may send further requests on the connection,
+          possibly before receiving the responses. Requests are handled & responded in order, until the client disconnects.
+   @param sock the socket a client connected to.
+   @return true if all requests succeeded. false otherwise.
+ */
+bool CServerLogic::handleSocketFromThread(boost::asio::ip::tcp::socket& sock)
+{
+	bool success = true;
+	bool persistent = false;   // client keeps the connection open for further requests.
+	do
+	{
+		uint8_t packet[PACKET_SIZE];
+		CLogger::SRecord record;
+		record.timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count());
+		auto start = std::chrono::steady_clock::now();
+		auto phaseStart = start;
+		if (!_socketHandler.receive(sock, packet))
 		{
-			err << "CServerLogic::handleSocketFromThread: Failed to receive first message from socket!" << std::endl;
+			if (persistent)
+				break;  // client closed its connection. Not an error.
+			record.error = ERROR_RECEIVE;
+			_logger.log(record);
 			return false;
 		}
-		request = deserializeRequest(buffer, PACKET_SIZE);
-		while (lock(*request) == false)  // If server is handling already exact user's ID request
+		if (persistent)  // don't account the time the connection was idle.
 		{
-			std::this_thread::sleep_for(std::chrono::seconds(3));
+			record.timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count());
+			start = phaseStart = std::chrono::steady_clock::now();
 		}
-		const bool success = handleRequest(*request, response, responseSent, sock, err);
-
-		// Free allocated memory.
-		if (!responseSent)
+		const uint32_t receiveUs = record.addPhase(CLogger::PHASE_RECEIVE, phaseStart);
+		PROBE1(receive__done, receiveUs);
+		try
 		{
-			serializeResponse(*response, buffer);
-			if (!_socketHandler.send(sock, buffer))
-			{
-				err << "Response sending on socket failed!" << std::endl;
-				destroy(response);
-				return false;
-			}
-			destroy(response);
-			sock.close();
+			if (!handleSocket(sock, packet, record, persistent))
+				success = false;
 		}
-		
-		unlock(*request);  // release lock on user id
+		catch (std::exception&)
+		{
+			record.error = ERROR_EXCEPTION;
+			persistent = false;
+			success = false;
+		}
+		record.durationUs = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count());
+		PROBE4(request__done, record.userId, record.op, record.status, record.durationUs);
+		_logger.log(record);
+	} while (persistent && sock.is_open());
+
+	boost::system::error_code error;
+	sock.close(error);
+	return success;
+}
+
+
+/**
+   @brief handle a request received from socket and respond.
+   @param sock the socket a client connected to.
+   @param packet the request's first packet.
+   @param record the request's log record.
+   @param persistent whether the connection may be used for further requests will be saved in this object.
+   @return true if operation succeeded. false otherwise.
+ */
+bool CServerLogic::handleSocket(boost::asio::ip::tcp::socket& sock, const uint8_t (&packet)[PACKET_SIZE], CLogger::SRecord& record, bool& persistent)
+{
+	uint8_t buffer[PACKET_SIZE];
+	SRequest* request = nullptr;    // allocated in deserializeRequest()
+	SResponse* response = nullptr;  // allocated in handleRequest()
+	bool responseSent = false;      // response was sent ?
+
+	request = deserializeRequest(packet, PACKET_SIZE);
+	record.userId = request->header.userId;
+	record.op = request->header.op;
+	record.bytes = request->payload.size;
+	persistent = (request->header.version >= CLIENT_VERSION_PERSISTENT);
+	PROBE3(request__start, record.userId, record.op, record.bytes);
+
+	// Only FILE_BACKUP payload may exceed the first packet. Skip any other, so following requests are read in sync.
+	if (request->header.op != SRequest::FILE_BACKUP && !skipPayload(sock, *request))
+	{
+		record.error = ERROR_PAYLOAD_RECEIVE;
+		traceRequest(*request, record, TRACE_HASH_SEED);
 		destroy(request);
-		
-		return success;
+		sock.close();
+		return false;
 	}
-	catch (std::exception& e)
+	auto phaseStart = std::chrono::steady_clock::now();
+	const CUserLock userLock(*this, record.userId, lockedFiles(*request));  // wait while server is handling the user's files
+	const uint32_t lockUs = record.addPhase(CLogger::PHASE_LOCK, phaseStart);
+	PROBE2(lock__acquired, record.userId, lockUs);
+	CQosScheduler::CAdmission admission(_scheduler, CQosScheduler::classify(request->header.op), record.userId);
+	uint64_t payloadHash = TRACE_HASH_SEED;
+	bool success = handleRequest(*request, response, responseSent, sock, record, admission, payloadHash);
+	record.phaseUs[CLogger::PHASE_QUEUE] += admission.waitedUs();   // excluded from the phases the accesses belong to.
+	PROBE3(queue__admitted, record.userId, admission.cls(), admission.waitedUs());
+
+	// Free allocated memory.
+	if (!responseSent)
 	{
-		err << "Exception in thread: " << e.what() << "\n";
-		return false;
+		record.status = response->status;
+		serializeResponse(*response, buffer);
+		phaseStart = std::chrono::steady_clock::now();
+		if (!_socketHandler.send(sock, buffer))
+		{
+			record.error = ERROR_SEND;
+			success = false;
+			sock.close();
+		}
+		const uint32_t sendUs = record.addPhase(CLogger::PHASE_SEND, phaseStart);
+		PROBE3(send__done, record.userId, record.status, sendUs);
+		destroy(response);
 	}
+	traceRequest(*request, record, payloadHash);
+	
+	destroy(request);   // user lock is released on return.
+	
+	return success;
 }
 
 
@@ -153,56 +289,61 @@ bool CServerLogic::handleSocketFromThread(boost::asio::ip::tcp::socket& sock, st
    @param response the response to the request which is allocated in this function.
    @param sock connected socket
    @param responseSent indicates whether a response was sent.
-   @param err description error. applicable only if function returns false.
+   @param record the request's log record. error is applicable only if function returns false.
+   @param admission the request's QoS standing. Each storage access is admitted separately (CQosScheduler::CAccess),
+          so the request holds no slot while it waits on the network.
+   @param payloadHash hash of the received payload. Calculated only while recording a trace with hashes.
    @return true if no error occurred. false, otherwise.
  */
-bool CServerLogic::handleRequest(const SRequest& request, SResponse*& response, bool& responseSent, boost::asio::ip::tcp::socket& sock, std::stringstream& err)
+bool CServerLogic::handleRequest(const SRequest& request, SResponse*& response, bool& responseSent, boost::asio::ip::tcp::socket& sock, CLogger::SRecord& record,
+	CQosScheduler::CAdmission& admission, uint64_t& payloadHash)
 {
 	responseSent = false;
 	response = new SResponse;
 	if (request.header.userId == 0) // invalid ID.
 	{
-		err << "Invalid User ID #" << +request.header.userId << std::endl;
+		record.error = ERROR_INVALID_USER;
 		response->status = SResponse::ERROR_GENERIC;
+		if (request.header.op == SRequest::FILE_BACKUP && !skipPayload(sock, request))
+			sock.close();
 		return false;
 	}
 	
-	// Common validation for FILE_RESTORE | FILE_REMOVE | FILE_DIR requests.
-	if ( (request.header.op & (SRequest::FILE_RESTORE | SRequest::FILE_REMOVE | SRequest::FILE_DIR)) == request.header.op)
+	const uint8_t op = request.header.op;  // request codes are not bit flags. compare explicitly.
+	const bool sourceOp = (op == SRequest::FILE_RESTORE || op == SRequest::FILE_REMOVE || op == SRequest::FILE_COPY || op == SRequest::FILE_RENAME);
+
+	// Common validation for FILE_RESTORE | FILE_REMOVE | FILE_DIR | FILE_COPY | FILE_RENAME requests.
+	if (sourceOp || op == SRequest::FILE_DIR)
 	{
 		if (!userHasFiles(request.header.userId))
 		{
-			err << "User #" << +request.header.userId << " has no files!" << std::endl;
+			record.error = ERROR_NO_FILES;
 			response->status = SResponse::ERROR_NO_FILES;
 			return false;
 		}
 	}
 
-	// Common validation for FILE_BACKUP | FILE_RESTORE | FILE_REMOVE requests.
+	// Common validation for FILE_BACKUP | FILE_RESTORE | FILE_REMOVE | FILE_COPY | FILE_RENAME requests.
 	std::string parsedFileName; // will be used as parsed filename string.
-	if ((request.header.op & (SRequest::FILE_BACKUP | SRequest::FILE_RESTORE | SRequest::FILE_REMOVE)) == request.header.op)
+	if (sourceOp || op == SRequest::FILE_BACKUP)
 	{
 		if (!parseFilename(request.nameLen, request.filename, parsedFileName))
 		{
-			err << "Request Error for user ID #" << +request.header.userId << ": Invalid filename!" << std::endl;
+			record.error = ERROR_INVALID_FILENAME;
 			response->status = SResponse::ERROR_GENERIC;
+			if (request.header.op == SRequest::FILE_BACKUP && !skipPayload(sock, request))
+				sock.close();
 			return false;
 		}
 		copyFilename(request, *response);
 	}
 
-	std::stringstream userPathSS;
-	std::stringstream filepathSS;
-	userPathSS << BACKUP_FOLDER << request.header.userId << "/";
-	filepathSS << userPathSS.str() << parsedFileName;
-	const std::string filepath = filepathSS.str();
-	
-	// Common validation for FILE_RESTORE | FILE_REMOVE requests.
-	if ((request.header.op & (SRequest::FILE_RESTORE | SRequest::FILE_REMOVE)) == request.header.op)
+	// Common validation for FILE_RESTORE | FILE_REMOVE | FILE_COPY | FILE_RENAME requests.
+	if (sourceOp)
 	{
-		if (!_fileHandler.fileExists(filepath))
+		if (!_storage->exists(request.header.userId, parsedFileName))
 		{
-			err << "Request Error for user ID #" << +request.header.userId << ": File not exists!" << std::endl;
+			record.error = ERROR_NOT_EXIST;
 			response->status = SResponse::ERROR_NOT_EXIST;
 			return false;
 		}
@@ -214,137 +355,458 @@ bool CServerLogic::handleRequest(const SRequest& request, SResponse*& response,
 	switch (request.header.op)
 	{
 	/**
-	   save file to disk. do not close socket on failure. response handled outside.
+	   save file to storage. The whole payload is received even on failure, keeping a persistent connection in sync.
+	   close socket only if receiving failed. response handled outside.
 	 */
 	case SRequest::FILE_BACKUP:
 	{
-		std::fstream fs;
-		if (!_fileHandler.fileOpen(filepath, fs, true))
+		EError error = ERROR_NONE;
+		auto phaseStart = std::chrono::steady_clock::now();
+		std::unique_ptr<CStorage::CWriteStream> file;
 		{
-			err << "user ID #" << +request.header.userId << ": File " << parsedFileName << " failed to open." << std::endl;
-			return false;
+			const CQosScheduler::CAccess disk(admission, phaseStart);
+			file = _storage->put(request.header.userId, parsedFileName, request.payload.size, error);
 		}
+		const uint32_t openUs = record.addPhase(CLogger::PHASE_OPEN, phaseStart);
+		PROBE3(open__done, request.header.userId, request.header.op, openUs);
 		uint32_t bytes = (PACKET_SIZE - request.sizeWithoutPayload());
 		if (request.payload.size < bytes)
 			bytes = request.payload.size;
-		if (!_fileHandler.fileWrite(fs, request.payload.payload, bytes))
+		const bool hashing = _tracer.recording() && _tracer.hashes();
+		if (hashing)
+			CTraceRecorder::hash(payloadHash, request.payload.payload, bytes);
+		if (file != nullptr)
 		{
-			err << "user ID #" << +request.header.userId << ": Write to file " << parsedFileName << " failed." << std::endl;
-			fs.close();
-			return false;
+			CQosScheduler::CAccess disk(admission, phaseStart);
+			disk.charge(bytes);
+			if (!file->write(request.payload.payload, bytes))
+				error = ERROR_FILE_WRITE;
 		}
 
 		while(bytes < request.payload.size)
 		{
 			if (!_socketHandler.receive(sock, buffer))
 			{
-				err << "user ID #" << +request.header.userId << ": receive file data from socket failed." << std::endl;
-				fs.close();
+				record.error = ERROR_PAYLOAD_RECEIVE;
+				sock.close();
 				return false;
 			}
 			uint32_t length = PACKET_SIZE;
 			if (bytes + PACKET_SIZE > request.payload.size)
 				length = request.payload.size - bytes;
-			if (!_fileHandler.fileWrite(fs, buffer, length))
+			if (hashing)
+				CTraceRecorder::hash(payloadHash, buffer, length);
+			if (error == ERROR_NONE)
 			{
-				err << "user ID #" << +request.header.userId << ": Write to file " << parsedFileName << " failed." << std::endl;
-				fs.close();
-				return false;
+				CQosScheduler::CAccess disk(admission, phaseStart);   // the chunk was received. Only its write is admitted.
+				disk.charge(length);
+				if (!file->write(buffer, length))
+					error = ERROR_FILE_WRITE;
 			}
 			bytes += length;
 		}
-		fs.close();
+		const uint32_t transferUs = record.addPhase(CLogger::PHASE_TRANSFER, phaseStart);
+		PROBE4(transfer__done, request.header.userId, request.header.op, bytes, transferUs);
+		if (error == ERROR_NONE)
+		{
+			const CQosScheduler::CAccess disk(admission, phaseStart);
+			if (!file->commit())
+				error = ERROR_FILE_COMMIT;
+		}
+		const uint32_t commitUs = record.addPhase(CLogger::PHASE_COMMIT, phaseStart);
+		PROBE2(commit__done, request.header.userId, commitUs);
+		if (error != ERROR_NONE)
+		{
+			record.error = error;
+			return false;
+		}
 		response->status = SResponse::SUCCESS_BACKUP_DELETE;
 		return true;
 	}
 
 	/**
-	   Restore file from disk. close socket on failure. specific socket logic.
+	   Restore file from storage. close socket on failure. specific socket logic.
 	 */
 	case SRequest::FILE_RESTORE:
 	{
-		std::fstream fs;
-		if (!_fileHandler.fileOpen(filepath, fs))
+		uint32_t selector = 0;   // 0 = current content. N = Nth previous version.
+		if (!parseSelector(request, selector))
 		{
-			err << "user ID #" << +request.header.userId << ": File " << parsedFileName << " failed to open." << std::endl;
+			record.error = ERROR_INVALID_SELECTOR;
 			return false;
 		}
-		uint32_t fileSize = _fileHandler.fileSize(fs);
+		EError error = ERROR_NONE;
+		auto phaseStart = std::chrono::steady_clock::now();
+		std::unique_ptr<CStorage::CReadStream> file;
+		CStorage::TExtents extents;
+		{
+			const CQosScheduler::CAccess disk(admission, phaseStart);
+			file = _storage->get(request.header.userId, parsedFileName, selector, error);
+			// clients supporting sparse restores receive the extent map & the extents' data, without the holes' zeros.
+			if (file != nullptr && file->size() != 0 && (request.header.version < CLIENT_VERSION_SPARSE || !file->extents(extents)))
+				extents.assign(1, std::make_pair(0u, file->size()));
+		}
+		const uint32_t openUs = record.addPhase(CLogger::PHASE_OPEN, phaseStart);
+		PROBE3(open__done, request.header.userId, request.header.op, openUs);
+		if (file == nullptr)
+		{
+			record.error = error;
+			if (error == ERROR_NOT_EXIST || error == ERROR_VERSION_NOT_EXIST)
+				response->status = SResponse::ERROR_NOT_EXIST;
+			return false;
+		}
+		uint32_t fileSize = file->size();
 		if (fileSize == 0)
 		{
-			err << "user ID #" << +request.header.userId << ": File " << parsedFileName << " has 0 zero." << std::endl;
-			fs.close();
+			record.error = ERROR_FILE_EMPTY;
 			return false;
 		}
-		response->payload.size = fileSize;
+
+		bool sparse = !(extents.size() == 1 && extents.front().first == 0 && extents.front().second == fileSize);
+		std::vector<uint8_t> extentMap;   // SUCCESS_RESTORE_SPARSE payload prefix.
+		uint64_t payloadSize = fileSize;
+		if (sparse)
+		{
+			SExtentMap header;
+			header.size = fileSize;
+			header.count = static_cast<uint32_t>(extents.size());
+			extentMap.resize(sizeof(header) + (extents.size() * sizeof(SExtent)));
+			memcpy(extentMap.data(), &header, sizeof(header));
+			payloadSize = extentMap.size();
+			for (size_t i = 0; i < extents.size(); ++i)
+			{
+				SExtent extent;
+				extent.offset = extents[i].first;
+				extent.length = extents[i].second;
+				memcpy(extentMap.data() + sizeof(header) + (i * sizeof(extent)), &extent, sizeof(extent));
+				payloadSize += extent.length;
+			}
+			sparse = (payloadSize <= UINT32_MAX);
+			if (!sparse)
+				payloadSize = fileSize;
+		}
+
+		// fill the next payload bytes. zero fills beyond the payload's end. Each fill is a single admitted disk access.
+		size_t mapOffset = 0;
+		size_t extent = 0;
+		uint32_t extentOffset = 0;
+		auto fill = [&](uint8_t* const data, const uint32_t length) -> bool
+		{
+			CQosScheduler::CAccess disk(admission, phaseStart);
+			disk.charge(length);
+			if (!sparse)
+				return file->read(data, length);
+			uint32_t filled = 0;
+			if (mapOffset < extentMap.size())
+			{
+				filled = static_cast<uint32_t>(std::min<size_t>(length, extentMap.size() - mapOffset));
+				memcpy(data, extentMap.data() + mapOffset, filled);
+				mapOffset += filled;
+			}
+			while (filled < length && extent < extents.size())
+			{
+				if (extentOffset == 0 && !file->seek(extents[extent].first))
+					return false;
+				const uint32_t chunk = std::min(length - filled, extents[extent].second - extentOffset);
+				if (!file->read(data + filled, chunk))
+					return false;
+				filled += chunk;
+				extentOffset += chunk;
+				if (extentOffset == extents[extent].second)
+				{
+					++extent;
+					extentOffset = 0;
+				}
+			}
+			memset(data + filled, 0, length - filled);
+			return true;
+		};
+
+		response->payload.size = static_cast<uint32_t>(payloadSize);
+		record.bytes = response->payload.size;
 		uint32_t bytes = (PACKET_SIZE - response->sizeWithoutPayload());
 		response->payload.payload = new uint8_t[bytes];
-		if (!_fileHandler.fileRead(fs, response->payload.payload, bytes))
+		if (!fill(response->payload.payload, bytes))
 		{
-			err << "user ID #" << +request.header.userId << ": File " << parsedFileName << " reading failed." << std::endl;
-			fs.close();
+			record.error = ERROR_FILE_READ;
 			return false;
 		}
 
 		// send first packet
 		responseSent = true;
-		response->status = SResponse::SUCCESS_RESTORE;
+		response->status = sparse ? SResponse::SUCCESS_RESTORE_SPARSE : SResponse::SUCCESS_RESTORE;
+		record.status = response->status;
 		serializeResponse(*response, buffer);
 		if (!_socketHandler.send(sock, buffer))
 		{
-			err << "Response sending on socket failed! user ID #" << +request.header.userId << std::endl;
-			fs.close();
+			record.error = ERROR_SEND;
 			sock.close();
 			return false;
 		}
 			
-		while(bytes < fileSize)
+		while(bytes < response->payload.size)
 		{
-			if (!_fileHandler.fileRead(fs, buffer, PACKET_SIZE) || !_socketHandler.send(sock, buffer))
+			if (!fill(buffer, PACKET_SIZE) || !_socketHandler.send(sock, buffer))
 			{
-				err << "Payload data failure for user ID #" << +request.header.userId << std::endl;
-				fs.close();
+				record.error = ERROR_PAYLOAD_SEND;
 				sock.close();
 				return false;
 			}
 			bytes += PACKET_SIZE;
 		}
+		const uint32_t transferUs = record.addPhase(CLogger::PHASE_TRANSFER, phaseStart);
+		PROBE4(transfer__done, request.header.userId, request.header.op, response->payload.size, transferUs);
+
+		destroy(response);
+		return true;
+	}
+
+	/**
+	   Stream all user's files, optionally filtered by a name prefix, as one archive. close socket on failure.
+	   Files are listed once & read ahead while the previous ones are sent.
+	 */
+	case SRequest::FILE_RESTORE_ALL:
+	{
+		std::string prefix;
+		if (request.nameLen != 0)
+		{
+			if (!parseFilename(request.nameLen, request.filename, prefix) || !isPlainName(prefix))
+			{
+				record.error = ERROR_INVALID_FILENAME;
+				return false;
+			}
+			copyFilename(request, *response);
+		}
+		auto phaseStart = std::chrono::steady_clock::now();
+		std::vector<CStorage::SScanEntry> files;
+		bool scanned = false;
+		{
+			const CQosScheduler::CAccess disk(admission, phaseStart);
+			scanned = _storage->scan(request.header.userId, prefix, files);
+			for (size_t i = 0; scanned && i < files.size() && i < RESTORE_ALL_READAHEAD; ++i)
+				_storage->prefetch(request.header.userId, files[i]);
+		}
+		if (!scanned)
+		{
+			record.error = ERROR_FILES_LIST;
+			return false;
+		}
+		if (files.empty())
+		{
+			const bool hasFiles = !prefix.empty() && userHasFiles(request.header.userId);
+			record.error = hasFiles ? ERROR_NOT_EXIST : ERROR_NO_FILES;
+			response->status = hasFiles ? SResponse::ERROR_NOT_EXIST : SResponse::ERROR_NO_FILES;
+			return false;
+		}
+		const uint32_t openUs = record.addPhase(CLogger::PHASE_OPEN, phaseStart);
+		PROBE3(open__done, request.header.userId, request.header.op, openUs);
+
+		// entries are packed into packets back to back. The first packet holds the response's header.
+		responseSent = true;
+		response->status = SResponse::SUCCESS_RESTORE_ALL;
+		response->payload.size = static_cast<uint32_t>(files.size());
+		response->payload.payload = new uint8_t[PACKET_SIZE - response->sizeWithoutPayload()]();   // overwritten by the stream.
+		record.status = response->status;
+		serializeResponse(*response, buffer);
+		uint32_t used = response->sizeWithoutPayload();
+		uint64_t sent = 0;
+		auto flush = [&]() -> bool
+		{
+			if (used < PACKET_SIZE)
+				return true;
+			used = 0;
+			sent += PACKET_SIZE;
+			return _socketHandler.send(sock, buffer);
+		};
+		auto emit = [&](const uint8_t* data, uint32_t length) -> bool
+		{
+			while (length > 0)
+			{
+				const uint32_t chunk = std::min(length, PACKET_SIZE - used);
+				memcpy(buffer + used, data, chunk);
+				used += chunk;
+				data += chunk;
+				length -= chunk;
+				if (!flush())
+					return false;
+			}
+			return true;
+		};
+
+		for (size_t i = 0; i < files.size(); ++i)
+		{
+			EError error = ERROR_NONE;
+			std::unique_ptr<CStorage::CReadStream> file;
+			{
+				const CQosScheduler::CAccess disk(admission, phaseStart);
+				if (i + RESTORE_ALL_READAHEAD < files.size())
+					_storage->prefetch(request.header.userId, files[i + RESTORE_ALL_READAHEAD]);
+				file = _storage->getScanned(request.header.userId, files[i], error);
+			}
+			if (file == nullptr)
+			{
+				record.error = error;
+				destroy(response);
+				sock.close();
+				return false;
+			}
+			SArchiveEntry entry;
+			entry.nameLen = static_cast<uint16_t>(files[i].filename.size());
+			uint32_t remaining = file->size();
+			if (!emit(reinterpret_cast<const uint8_t*>(&entry), sizeof(entry)) ||
+				!emit(reinterpret_cast<const uint8_t*>(files[i].filename.data()), entry.nameLen) ||
+				!emit(reinterpret_cast<const uint8_t*>(&remaining), sizeof(remaining)))
+			{
+				record.error = ERROR_PAYLOAD_SEND;
+				destroy(response);
+				sock.close();
+				return false;
+			}
+			while (remaining > 0)   // read straight into the packet being filled.
+			{
+				const uint32_t chunk = std::min(remaining, PACKET_SIZE - used);
+				bool read = false;
+				{
+					CQosScheduler::CAccess disk(admission, phaseStart);
+					disk.charge(chunk);
+					read = file->read(buffer + used, chunk);
+				}
+				if (!read)
+				{
+					record.error = ERROR_FILE_READ;
+					destroy(response);
+					sock.close();
+					return false;
+				}
+				used += chunk;
+				remaining -= chunk;
+				if (!flush())
+				{
+					record.error = ERROR_PAYLOAD_SEND;
+					destroy(response);
+					sock.close();
+					return false;
+				}
+			}
+		}
+		SArchiveEntry end;   // nameLen 0 ends the stream.
+		end.nameLen = 0;
+		bool ended = emit(reinterpret_cast<const uint8_t*>(&end), sizeof(end));
+		if (ended && used != 0)  // zero pad the last packet.
+		{
+			memset(buffer + used, 0, PACKET_SIZE - used);
+			used = PACKET_SIZE;
+			ended = flush();
+		}
+		if (!ended)
+		{
+			record.error = ERROR_PAYLOAD_SEND;
+			destroy(response);
+			sock.close();
+			return false;
+		}
+		record.bytes = static_cast<uint32_t>(std::min<uint64_t>(sent, UINT32_MAX));
+		const uint32_t transferUs = record.addPhase(CLogger::PHASE_TRANSFER, phaseStart);
+		PROBE4(transfer__done, request.header.userId, request.header.op, record.bytes, transferUs);
 
 		destroy(response);
-		fs.close();
-		sock.close();
 		return true;
 	}
 
 	/**
-	   Remove file from disk. response handled outside.
+	   Remove file and its versions from storage. response handled outside.
 	 */
 	case SRequest::FILE_REMOVE:
 	{
-		if (!_fileHandler.fileRemove(filepath))
+		auto phaseStart = std::chrono::steady_clock::now();
+		bool removed = false;
+		{
+			const CQosScheduler::CAccess disk(admission, phaseStart);
+			removed = _storage->remove(request.header.userId, parsedFileName);
+		}
+		if (!removed)
 		{
-			err << "Request Error for user ID #" << +request.header.userId << ": File deletion failed!" << std::endl;
+			record.error = ERROR_FILE_REMOVE;
+			return false;
+		}
+		response->status = SResponse::SUCCESS_BACKUP_DELETE;
+		return true;
+	}
+
+	/**
+	   Copy / rename a file within the user's files. The server's storage moves no data over the network.
+	   response handled outside.
+	 */
+	case SRequest::FILE_COPY:
+	case SRequest::FILE_RENAME:
+	{
+		std::string destination;
+		if (request.payload.size > (PACKET_SIZE - request.sizeWithoutPayload()) ||  // destination is within the first packet.
+			!parseFilename(static_cast<uint16_t>(request.payload.size), request.payload.payload, destination) ||
+			!isPlainName(parsedFileName) || !isPlainName(destination))
+		{
+			record.error = ERROR_INVALID_FILENAME;
+			return false;
+		}
+		EError error = ERROR_NONE;
+		auto phaseStart = std::chrono::steady_clock::now();
+		bool done = false;
+		{
+			const CQosScheduler::CAccess disk(admission, phaseStart);
+			done = (request.header.op == SRequest::FILE_COPY) ?
+				_storage->copy(request.header.userId, parsedFileName, destination, error) :
+				_storage->rename(request.header.userId, parsedFileName, destination, error);
+		}
+		const uint32_t transferUs = record.addPhase(CLogger::PHASE_TRANSFER, phaseStart);
+		PROBE4(transfer__done, request.header.userId, request.header.op, 0, transferUs);
+		if (!done)
+		{
+			record.error = error;
+			if (error == ERROR_NOT_EXIST)
+				response->status = SResponse::ERROR_NOT_EXIST;
 			return false;
 		}
 		response->status = SResponse::SUCCESS_BACKUP_DELETE;
 		return true;
 	}
 
-	
 	/**
 	   Read file list from disk, separate to packets if file names size exceeding PACKET_SIZE, send to client.
 	   Specific socket logic. close socket on failure.
 	*/
 	case SRequest::FILE_DIR:
 	{
-		std::set<std::string> userFiles;
-		std::string userFolder(userPathSS.str());
-		if (!_fileHandler.getFilesList(userFolder, userFiles))
+		// Optionally list versions as "filename@N", where N is the selector to restore it with.
+		uint32_t withVersions = 0;
+		if (!parseSelector(request, withVersions))
 		{
-			err << "Request Error for user ID #" << +request.header.userId << ": FILE_DIR generic failure." << std::endl;
-			response->status = SResponse::ERROR_GENERIC;  // can be only generic error. empty files were validated before.
+			record.error = ERROR_INVALID_SELECTOR;
 			return false;
 		}
+		auto phaseStart = std::chrono::steady_clock::now();
+		std::set<std::string> userFiles;
+		{
+			const CQosScheduler::CAccess disk(admission, phaseStart);
+			if (!_storage->list(request.header.userId, userFiles))
+			{
+				record.error = ERROR_FILES_LIST;
+				response->status = SResponse::ERROR_GENERIC;  // can be only generic error. empty files were validated before.
+				return false;
+			}
+			std::vector<std::string> versionEntries;
+			for (const auto& fn : userFiles)
+			{
+				uint32_t versions = 0;
+				if (withVersions != 0 && !_storage->versions(request.header.userId, fn, versions))
+				{
+					record.error = ERROR_VERSIONS_LIST;
+					return false;
+				}
+				for (uint32_t i = 1; i <= versions; ++i)
+					versionEntries.push_back(fn + "@" + std::to_string(i));
+			}
+			userFiles.insert(versionEntries.begin(), versionEntries.end());
+		}
 		const size_t filenameLen = 32;  // random string length, as required.
 		response->filename = new uint8_t[filenameLen];
 		response->nameLen = filenameLen;
@@ -356,6 +818,7 @@ bool CServerLogic::handleRequest(const SRequest& request, SResponse*& response,
 		for (const auto& fn : userFiles)
 			listSize += fn.size() + 1;  // +1 for '\n' to represent filename ending.
 		response->payload.size = listSize;
+		record.bytes = static_cast<uint32_t>(listSize);
 		auto const listPtr = new uint8_t[listSize];           // assumption: listSize will not exceed RAM. (mentioned in forum).
 		auto ptr = listPtr;
 		for (const auto& fn : userFiles)
@@ -374,6 +837,7 @@ bool CServerLogic::handleRequest(const SRequest& request, SResponse*& response,
 		// file names exceed PACKET_SIZE. Split Message.
 		ptr = listPtr;
 		responseSent = true;  // specific sending logic. no need to send after function end.
+		record.status = response->status;
 		uint32_t bytes = PACKET_SIZE - response->sizeWithoutPayload();  // leftover bytes
 		response->payload.payload = new uint8_t[bytes];
 		memcpy(response->payload.payload, ptr, bytes);
@@ -381,9 +845,11 @@ bool CServerLogic::handleRequest(const SRequest& request, SResponse*& response,
 		
 		// send first packet
 		serializeResponse(*response, buffer);
+		phaseStart = std::chrono::steady_clock::now();
 		if (!_socketHandler.send(sock, buffer))
 		{
-			err << "Response sending on socket failed! user ID #" << +request.header.userId << std::endl;
+			record.error = ERROR_SEND;
+			delete[] listPtr;
 			destroy(response);
 			sock.close();
 			return false;
@@ -392,25 +858,30 @@ bool CServerLogic::handleRequest(const SRequest& request, SResponse*& response,
 		bytes = PACKET_SIZE;  // bytes sent.
 		while (bytes < (response->sizeWithoutPayload() + listSize))
 		{
-			memcpy(buffer, ptr, PACKET_SIZE);
-			ptr += PACKET_SIZE;
+			const size_t leftover = std::min<size_t>(PACKET_SIZE, listSize - (ptr - listPtr));  // the last packet is zero padded.
+			memset(buffer, 0, PACKET_SIZE);
+			memcpy(buffer, ptr, leftover);
+			ptr += leftover;
 			bytes += PACKET_SIZE;
 			if (!_socketHandler.send(sock, buffer))
 			{
-				err << "Payload data failure for user ID #" << +request.header.userId << std::endl;
+				record.error = ERROR_PAYLOAD_SEND;
+				delete[] listPtr;
 				destroy(response);
 				sock.close();
 				return false;
 			}
 		}
+		delete[] listPtr;
+		const uint32_t sendUs = record.addPhase(CLogger::PHASE_SEND, phaseStart);
+		PROBE3(send__done, request.header.userId, response->status, sendUs);
 			
 		destroy(response);
-		sock.close();
 		return true;
 	}
 	default:  // response handled outside.
 	{
-		err << "Request Error for user ID #" << +request.header.userId << ": Invalid request code: " << +request.header.op << std::endl;
+		record.error = ERROR_INVALID_OP;
 		return true;
 	}
 	} // end of switch
@@ -440,14 +911,17 @@ CServerLogic::SRequest* CServerLogic::deserializeRequest(const uint8_t* const bu
 	memcpy(&(request->nameLen), ptr, sizeof(uint16_t));
 	bytesRead += sizeof(uint16_t);
 	ptr += sizeof(uint16_t);
-	if ((request->nameLen == 0) || ((bytesRead + request->nameLen) > size))
+	if ((bytesRead + request->nameLen) > size)
 		return request;  // name length invalid.
 
-	request->filename = new uint8_t[request->nameLen + 1];
-	memcpy(request->filename, ptr, request->nameLen);
-	request->filename[request->nameLen] = '\0';
-	bytesRead += request->nameLen;
-	ptr += request->nameLen;
+	if (request->nameLen != 0)  // FILE_DIR has no filename, yet may have a payload.
+	{
+		request->filename = new uint8_t[request->nameLen + 1];
+		memcpy(request->filename, ptr, request->nameLen);
+		request->filename[request->nameLen] = '\0';
+		bytesRead += request->nameLen;
+		ptr += request->nameLen;
+	}
 	
 	if (bytesRead + sizeof(uint32_t) > size)
 		return request;
@@ -520,19 +994,137 @@ void CServerLogic::destroy(SResponse* response)
 	}
 }
 
-bool CServerLogic::lock(const SRequest& request)
+/**
+   @brief skip the payload packets following a request's first packet.
+   @param sock the socket the request was received from.
+   @param request the request whose payload is skipped.
+   @return true if skipped successfully. false if receiving failed.
+ */
+bool CServerLogic::skipPayload(boost::asio::ip::tcp::socket& sock, const SRequest& request)
 {
-	if (request.header.userId == 0)
-		return true;
-	if (_userHandling[request.header.userId])
-		return false;
-	_userHandling[request.header.userId] = true;
+	uint8_t buffer[PACKET_SIZE];
+	uint32_t bytes = (PACKET_SIZE - request.sizeWithoutPayload());  // received within the first packet.
+	while (bytes < request.payload.size)
+	{
+		if (!_socketHandler.receive(sock, buffer))
+			return false;
+		bytes += PACKET_SIZE;
+	}
 	return true;
 }
 
-void CServerLogic::unlock(const SRequest& request)
+/**
+   @brief append a handled request to the trace, if recording.
+   @param request the request.
+   @param record the request's log record. Its status is recorded, 0 if no response was sent.
+   @param payloadHash the hash of the request's FILE_BACKUP payload.
+ */
+void CServerLogic::traceRequest(const SRequest& request, const CLogger::SRecord& record, const uint64_t payloadHash)
 {
-	if (request.header.userId == 0)
+	if (!_tracer.recording())
 		return;
-	_userHandling[request.header.userId] = false;
-}
\ No newline at end of file
+	CTraceRecorder::SRecord trace;
+	trace.offsetUs = _tracer.offset(record.timestamp);
+	trace.userId = request.header.userId;
+	trace.version = request.header.version;
+	trace.op = request.header.op;
+	trace.nameLen = (request.filename != nullptr) ? request.nameLen : 0;
+	trace.payloadSize = request.payload.size;
+	uint16_t controlLen = 0;   // a payload other than FILE_BACKUP data is within the first packet. Recorded verbatim.
+	if (request.header.op != SRequest::FILE_BACKUP && request.payload.payload != nullptr)
+		controlLen = static_cast<uint16_t>(std::min<uint32_t>(request.payload.size, PACKET_SIZE - request.sizeWithoutPayload()));
+	_tracer.record(trace, request.filename, request.payload.payload, controlLen, record.status, payloadHash);
+}
+
+/**
+   @brief the user's files a request accesses, named as stored.
+   @param request the request received.
+   @return the filename, and the destination of a copy or rename. Empty for a request on all the user's files,
+           or a request whose names can't be parsed (its handling fails, but it is locked conservatively).
+ */
+std::vector<std::string> CServerLogic::lockedFiles(const SRequest& request)
+{
+	std::vector<std::string> files;
+	std::string name;
+	switch (request.header.op)
+	{
+	case SRequest::FILE_BACKUP:
+	case SRequest::FILE_RESTORE:
+	case SRequest::FILE_REMOVE:
+		if (parseFilename(request.nameLen, request.filename, name))
+			files.push_back(name);
+		break;
+	case SRequest::FILE_COPY:
+	case SRequest::FILE_RENAME:
+	{
+		std::string destination;
+		if (request.payload.size <= (PACKET_SIZE - request.sizeWithoutPayload()) &&
+			parseFilename(request.nameLen, request.filename, name) &&
+			parseFilename(static_cast<uint16_t>(request.payload.size), request.payload.payload, destination))
+		{
+			files.push_back(name);
+			files.push_back(destination);
+		}
+		break;
+	}
+	default:   // FILE_DIR, FILE_RESTORE_ALL or invalid.
+		break;
+	}
+	return files;
+}
+
+/**
+   @brief wait until no other request of the same user handles any of the files, then mark them as handled.
+   @param userId the user. 0 isn't locked.
+   @param files the files to lock. Empty locks all the user's files: waits until none is handled.
+ */
+void CServerLogic::lock(const uint32_t userId, const std::vector<std::string>& files)
+{
+	if (userId == 0)
+		return;
+	std::unique_lock<std::mutex> guard(_usersMutex);
+	SUserLocks& locks = _usersHandled[userId];
+	locks.requests++;   // keeps the entry while waiting.
+	if (files.empty())
+	{
+		locks.allWaiting++;
+		_userReleased.wait(guard, [&locks]() { return (!locks.all && locks.files.empty()); });
+		locks.allWaiting--;
+		locks.all = true;
+		return;
+	}
+	_userReleased.wait(guard, [&locks, &files]()
+	{
+		if (locks.all || locks.allWaiting > 0)
+			return false;
+		for (const auto& file : files)
+		{
+			if (locks.files.count(file) != 0)
+				return false;
+		}
+		return true;
+	});
+	locks.files.insert(files.begin(), files.end());
+}
+
+/**
+   @brief release the files locked by lock().
+   @param userId the user. 0 isn't locked.
+   @param files the files given to lock().
+ */
+void CServerLogic::unlock(const uint32_t userId, const std::vector<std::string>& files)
+{
+	if (userId == 0)
+		return;
+	{
+		std::lock_guard<std::mutex> guard(_usersMutex);
+		SUserLocks& locks = _usersHandled[userId];
+		if (files.empty())
+			locks.all = false;
+		for (const auto& file : files)
+			locks.files.erase(locks.files.find(file));   // one instance: copy onto itself locks the name twice.
+		if (--locks.requests == 0)
+			_usersHandled.erase(userId);
+	}
+	_userReleased.notify_all();
+}
@@ -5,95 +5,87 @@
  */
 
 #pragma once
-#include "CFileHandler.h"
+#include "CLogger.h"
+#include "CQosScheduler.h"
+#include "CServerConfig.h"
 #include "CSocketHandler.h"
+#include "CStorage.h"
+#include "CTraceRecorder.h"
+#include "Protocol.h"
+#include <condition_variable>
 #include <map>
-#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
 #include <boost/asio/ip/tcp.hpp>
 
 
 class CServerLogic
 {
+#define RESTORE_ALL_READAHEAD  16   // FILE_RESTORE_ALL: files read ahead of the one being sent.
 public:
-	
-#define SERVER_VERSION 1  // Shouldn't be verified. Requirement from forum.
-#define BACKUP_FOLDER  "c:/backupsvr/"
-	
-    struct SPayload  // Common for Request & Response.
-    {
-        uint32_t size;     // payload size
-        uint8_t* payload;
-        SPayload() : size(0), payload(nullptr) {}
-    };
+    typedef ::SPayload  SPayload;
+    typedef ::SRequest  SRequest;
+    typedef ::SResponse SResponse;
 
-
-    struct SRequest
+private:
+    // holds a lock on the user's files a request accesses, for the lifetime of its handling. Released even if handling throws.
+    // Requests of a user on distinct files are handled concurrently. A request on all the user's files (no files given) runs alone.
+    class CUserLock
     {
-#pragma pack(push, 1)      // SRequestHeader is copied to buffer to send on socket. Hence, should be aligned to 1.
-        struct SRequestHeader
-        {
-            uint32_t userId;     // User ID
-            uint8_t  version;    // Client Version
-            uint8_t  op;         // Request Code
-            SRequestHeader() : userId(0), version(0), op(0) {}
-        };
-#pragma pack(pop)
-    	
-        enum EOp
-        {
-            FILE_BACKUP = 100,  // Save file backup. All fields should be valid.
-            FILE_RESTORE = 200,  // Restore a file. size, payload unused.
-            FILE_REMOVE = 201,  // Delete a file. size, payload unused.
-            FILE_DIR = 202   // List all client's files. name_len, filename, size, payload unused.
-        };
-    	
-        SRequestHeader header;  // request header
-        uint16_t nameLen;       // FileName length
-        uint8_t* filename;      // FileName
-        SPayload payload;
-        SRequest() : nameLen(0), filename(nullptr) {}
-        uint32_t sizeWithoutPayload() const { return (sizeof(header) + sizeof(nameLen) + nameLen + sizeof(payload.size)); }
+        CServerLogic&            _logic;
+        uint32_t                 _userId;
+        std::vector<std::string> _files;
+    public:
+        CUserLock(CServerLogic& logic, const uint32_t userId, const std::vector<std::string>& files) :
+            _logic(logic), _userId(userId), _files(files) { _logic.lock(_userId, _files); }
+        ~CUserLock() { _logic.unlock(_userId, _files); }
+        CUserLock(const CUserLock& other) = delete;
+        CUserLock& operator=(const CUserLock& other) = delete;
     };
-    struct SResponse
+
+    struct SUserLocks   // a user's requests being handled.
     {
-        enum EStatus
-        {
-            SUCCESS_RESTORE = 210,   // File was found and restored. all fields are valid.
-            SUCCESS_DIR = 211,   // Files listing returned successfully. all fields are valid.
-            SUCCESS_BACKUP_DELETE = 212,   // File was successfully backed up or deleted. size, payload are invalid. [From forum].
-            ERROR_NOT_EXIST = 1001,  // File doesn't exist. size, payload are invalid.
-            ERROR_NO_FILES = 1002,  // Client has no files. Only status & version are valid.
-            ERROR_GENERIC = 1003   // Generic server error. Only status & version are valid.
-        };
-    	
-        const uint8_t version;    // Server Version
-        uint16_t status;          // Request status
-        uint16_t nameLen;         // FileName length
-        uint8_t* filename;        // FileName
-        SPayload payload;
-        SResponse() : version(SERVER_VERSION), status(0), nameLen(0), filename(nullptr) {}
-        uint32_t sizeWithoutPayload() const { return (sizeof(version) + sizeof(status) + sizeof(nameLen) + nameLen + sizeof(payload.size)); }
+        std::multiset<std::string> files;   // files locked by requests on specific files.
+        bool     all;                       // a request on all the user's files is handled.
+        uint32_t allWaiting;                // requests on all the user's files waiting. Hold off new file requests meanwhile.
+        uint32_t requests;                  // requests holding or waiting for a lock. Removed when none is left.
+        SUserLocks() : all(false), allWaiting(0), requests(0) {}
     };
 
-
-private:
-    CFileHandler   _fileHandler;
     CSocketHandler _socketHandler; 
-    std::map<uint32_t, std::atomic<bool>> _userHandling;         // indicates whether working on user's request
+    std::unique_ptr<CStorage> _storage;                          // users' files backend. selected at startup.
+    CLogger        _logger;
+    CTraceRecorder _tracer;
+    CQosScheduler  _scheduler;                                   // admits requests by priority class & fair share.
+    std::map<uint32_t, SUserLocks> _usersHandled;                // users whose requests are being handled.
+    std::mutex     _usersMutex;
+    std::condition_variable _userReleased;
     std::string randString(const uint32_t length) const;
     bool userHasFiles(const uint32_t userId);
     bool parseFilename(const uint16_t filenameLength, const uint8_t* filename, std::string& parsedFilename);
+    static bool isPlainName(const std::string& name);
+    bool parseSelector(const SRequest& request, uint32_t& selector);
     void copyFilename(const SRequest& request, SResponse& response);
-    bool handleRequest(const SRequest&, SResponse*&, bool& responseSent, boost::asio::ip::tcp::socket& sock, std::stringstream& err);
+    bool handleSocket(boost::asio::ip::tcp::socket& sock, const uint8_t (&packet)[PACKET_SIZE], CLogger::SRecord& record, bool& persistent);
+    bool handleRequest(const SRequest&, SResponse*&, bool& responseSent, boost::asio::ip::tcp::socket& sock, CLogger::SRecord& record,
+        CQosScheduler::CAdmission& admission, uint64_t& payloadHash);
     SRequest* deserializeRequest(const uint8_t* const buffer, const uint32_t size);
     void serializeResponse(const SResponse& response, uint8_t* buffer);
     void destroy(uint8_t* ptr);
     void destroy(SRequest* request);
     void destroy(SResponse* response);
-    bool lock(const SRequest& request);
-    void unlock(const SRequest& request);
+    bool skipPayload(boost::asio::ip::tcp::socket& sock, const SRequest& request);
+    void traceRequest(const SRequest& request, const CLogger::SRecord& record, const uint64_t payloadHash);
+    std::vector<std::string> lockedFiles(const SRequest& request);
+    void lock(const uint32_t userId, const std::vector<std::string>& files);
+    void unlock(const uint32_t userId, const std::vector<std::string>& files);
 
 public:
-    bool handleSocketFromThread(boost::asio::ip::tcp::socket& sock, std::stringstream& err);
+    bool initialize(const CServerConfig& config, std::stringstream& err);
+    void shutdown();
+    bool handleSocketFromThread(boost::asio::ip::tcp::socket& sock);
 };
 
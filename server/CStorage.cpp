@@ -0,0 +1,59 @@
+/**
+   Maman 14
+   @CStorage storage backend interface for users' files. Selected at startup (--storage).
+   @author Roman Koifman
+ */
+
+#include "CStorage.h"
+#include "CFileStorage.h"
+#include "CMemoryStorage.h"
+
+
+/**
+   @brief create & initialize the storage backend selected by config.
+   @param config the server settings.
+   @param err description error. applicable only if function returns nullptr.
+   @return the storage backend. nullptr upon failure.
+ */
+std::unique_ptr<CStorage> CStorage::create(const CServerConfig& config, std::stringstream& err)
+{
+	std::unique_ptr<CStorage> storage;
+	try
+	{
+		if (config.storage == CServerConfig::STORAGE_MEMORY)
+			storage = std::make_unique<CMemoryStorage>();
+		else
+			storage = std::make_unique<CFileStorage>();
+	}
+	catch (std::exception& e)
+	{
+		err << "CStorage::create: " << e.what() << std::endl;
+		return nullptr;
+	}
+	if (!storage->initialize(config, err))
+		return nullptr;
+	return storage;
+}
+
+
+/**
+   @brief list a user's files starting with prefix, in the order they are best read sequentially.
+          By default, in name order.
+   @param userId the user's id.
+   @param prefix file names filter. Empty for all files.
+   @param files the matching files, with where they were found, for prefetch() & getScanned(). By default, location 0.
+   @return true if listed successfully. false otherwise.
+ */
+bool CStorage::scan(const uint32_t userId, const std::string& prefix, std::vector<SScanEntry>& files)
+{
+	std::set<std::string> userFiles;
+	if (!list(userId, userFiles))
+		return false;
+	files.clear();
+	for (const auto& fn : userFiles)
+	{
+		if (fn.compare(0, prefix.size(), prefix) == 0)
+			files.emplace_back(fn, 0);
+	}
+	return true;
+}
@@ -0,0 +1,77 @@
+/**
+   Maman 14
+   @CStorage storage backend interface for users' files. Selected at startup (--storage).
+   @author Roman Koifman
+ */
+
+#pragma once
+#include "Errors.h"
+#include "CServerConfig.h"
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+class CStorage
+{
+public:
+    typedef std::vector<std::pair<uint32_t, uint32_t>> TExtents;   // (offset, length) data extents, ascending.
+
+    struct SScanEntry        // a file found by scan().
+    {
+        std::string filename;
+        uint32_t    location;  // where the backend found the file, e.g. its backup folder. Spares locating it again.
+        SScanEntry(const std::string& name, const uint32_t where) : filename(name), location(where) {}
+    };
+
+    /**
+       A file being stored. Data is written sequentially, in non empty chunks. commit() completes the file.
+       A stream destroyed without commit() leaves the file content undefined.
+       Backends may leave all-zero blocks unallocated (holes).
+     */
+    class CWriteStream
+    {
+    public:
+        virtual ~CWriteStream() = default;
+        virtual bool write(const uint8_t* const data, const uint32_t bytes) = 0;
+        virtual bool commit() = 0;
+    };
+
+    /**
+       A stored file being read sequentially. Reading beyond the file's end zero fills.
+       extents() maps the file's data. Bytes outside the extents are zero. By default, the whole file is data.
+     */
+    class CReadStream
+    {
+    public:
+        virtual ~CReadStream() = default;
+        virtual uint32_t size() const = 0;
+        virtual bool read(uint8_t* const data, const uint32_t bytes) = 0;
+        virtual bool seek(const uint32_t offset) = 0;
+        virtual bool extents(TExtents& extents) { extents.assign(1, std::make_pair(0u, size())); return true; }
+    };
+
+    virtual ~CStorage() = default;
+    virtual bool initialize(const CServerConfig& config, std::stringstream& err) = 0;
+    virtual void shutdown() = 0;
+
+    virtual std::unique_ptr<CWriteStream> put(const uint32_t userId, const std::string& filename, const uint32_t size, EError& error) = 0;
+    virtual std::unique_ptr<CReadStream> get(const uint32_t userId, const std::string& filename, const uint32_t version, EError& error) = 0;
+    virtual bool remove(const uint32_t userId, const std::string& filename) = 0;
+    virtual bool copy(const uint32_t userId, const std::string& source, const std::string& destination, EError& error) = 0;
+    virtual bool rename(const uint32_t userId, const std::string& source, const std::string& destination, EError& error) = 0;
+    virtual bool list(const uint32_t userId, std::set<std::string>& files) = 0;
+    virtual bool versions(const uint32_t userId, const std::string& filename, uint32_t& count) = 0;
+    virtual bool exists(const uint32_t userId, const std::string& filename) = 0;
+    virtual bool scan(const uint32_t userId, const std::string& prefix, std::vector<SScanEntry>& files);
+    virtual void prefetch(const uint32_t userId, const SScanEntry& file) { (void)userId; (void)file; }
+    virtual std::unique_ptr<CReadStream> getScanned(const uint32_t userId, const SScanEntry& file, EError& error)
+    {
+        return get(userId, file.filename, 0, error);
+    }
+
+    static std::unique_ptr<CStorage> create(const CServerConfig& config, std::stringstream& err);
+};
@@ -0,0 +1,130 @@
+/**
+   Maman 14
+   @CTraceRecorder records a compact binary trace of incoming requests, to be replayed by the replay tool.
+   @author Roman Koifman
+ */
+
+#include "CTraceRecorder.h"
+#include <chrono>
+#include <cstring>
+
+
+CTraceRecorder::~CTraceRecorder()
+{
+	stop();
+}
+
+
+/**
+   @brief start recording. The trace file is overwritten.
+   @param filepath the trace file.
+   @param hashes record a hash of each request's payload.
+   @return true if trace file was created successfully. false otherwise.
+ */
+bool CTraceRecorder::start(const std::string& filepath, const bool hashes)
+{
+	try
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		if (_recording)
+			return true;
+		_file.open(filepath, std::ofstream::binary | std::ofstream::out | std::ofstream::trunc);
+		if (!_file.is_open())
+			return false;
+		SFileHeader header;
+		memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+		header.flags = TRACE_FLAG_CONTROL | TRACE_FLAG_STATUS | (hashes ? TRACE_FLAG_HASHES : 0);
+		header.startTime = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count());
+		_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		_startTime = header.startTime;
+		_hashes = hashes;
+		_recording = _file.good();
+		return _recording;
+	}
+	catch (std::exception&)
+	{
+		return false;
+	}
+}
+
+
+/**
+   @brief stop recording and flush the trace file.
+ */
+void CTraceRecorder::stop()
+{
+	try
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		_recording = false;
+		if (_file.is_open())
+			_file.close();
+	}
+	catch (std::exception&)
+	{
+	}
+}
+
+
+/**
+   @brief convert a timestamp to an offset from trace start.
+   @param timestamp microseconds since epoch.
+   @return microseconds since trace start.
+ */
+uint64_t CTraceRecorder::offset(const uint64_t timestamp) const
+{
+	return (timestamp > _startTime) ? (timestamp - _startTime) : 0;
+}
+
+
+/**
+   @brief append a request to the trace. Records are appended when requests end,
+          hence they are ordered by completion rather than by offsetUs.
+   @param record the request's fields.
+   @param filename the request's filename. record.nameLen bytes. May be nullptr only if nameLen is 0.
+   @param control the request's control payload, recorded verbatim. May be nullptr only if controlLen is 0.
+          File data must not be passed: it is represented by its size & hash only.
+   @param controlLen the control payload's size.
+   @param status the response status. 0 if the request got no response, e.g. its payload wasn't received.
+   @param payloadHash the payload hash. Ignored if not recording hashes.
+ */
+void CTraceRecorder::record(const SRecord& record, const uint8_t* filename, const uint8_t* control, const uint16_t controlLen, const uint16_t status,
+	const uint64_t payloadHash)
+{
+	if (!_recording)
+		return;
+	try
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		if (!_recording)
+			return;
+		_file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+		if (record.nameLen != 0)
+			_file.write(reinterpret_cast<const char*>(filename), record.nameLen);
+		_file.write(reinterpret_cast<const char*>(&controlLen), sizeof(controlLen));
+		if (controlLen != 0)
+			_file.write(reinterpret_cast<const char*>(control), controlLen);
+		_file.write(reinterpret_cast<const char*>(&status), sizeof(status));
+		if (_hashes)
+			_file.write(reinterpret_cast<const char*>(&payloadHash), sizeof(payloadHash));
+	}
+	catch (std::exception&)
+	{
+	}
+}
+
+
+/**
+   @brief incrementally hash data (FNV-1a 64). state should be initialized to TRACE_HASH_SEED.
+ */
+void CTraceRecorder::hash(uint64_t& state, const uint8_t* data, const uint32_t size)
+{
+	if (data == nullptr)
+		return;
+	for (uint32_t i = 0; i < size; ++i)
+	{
+		state ^= data[i];
+		state *= TRACE_HASH_PRIME;
+	}
+}
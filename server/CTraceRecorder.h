@@ -0,0 +1,67 @@
+/**
+   Maman 14
+   @CTraceRecorder records a compact binary trace of incoming requests, to be replayed by the replay tool.
+   @author Roman Koifman
+ */
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+class CTraceRecorder
+{
+public:
+#define TRACE_MAGIC          "BKTRACE1"   // 8 bytes file signature.
+#define TRACE_FLAG_HASHES    0x1          // records carry a payload hash.
+#define TRACE_FLAG_CONTROL   0x2          // records carry their control payload (version selector, flags, destination filename).
+#define TRACE_FLAG_STATUS    0x4          // records carry their response status.
+#define TRACE_HASH_SEED      0xcbf29ce484222325ULL   // FNV-1a 64 offset basis.
+#define TRACE_HASH_PRIME     0x100000001b3ULL
+
+#pragma pack(push, 1)   // written to file as is.
+    struct SFileHeader
+    {
+        char     magic[8];
+        uint32_t flags;
+        uint64_t startTime;      // trace start, microseconds since epoch.
+        SFileHeader() : magic(), flags(0), startTime(0) {}
+    };
+
+    struct SRecord           // followed by nameLen bytes of filename, then if TRACE_FLAG_CONTROL a 2 bytes control length
+                             // and the control payload, then if TRACE_FLAG_STATUS a 2 bytes response status (0 = no response),
+                             // then payloadHash if TRACE_FLAG_HASHES.
+    {
+        uint64_t offsetUs;       // request arrival, microseconds since trace start.
+        uint32_t userId;
+        uint8_t  version;
+        uint8_t  op;
+        uint16_t nameLen;
+        uint32_t payloadSize;
+        SRecord() : offsetUs(0), userId(0), version(0), op(0), nameLen(0), payloadSize(0) {}
+    };
+#pragma pack(pop)
+
+    CTraceRecorder() : _recording(false), _hashes(false), _startTime(0) {}
+    CTraceRecorder(const CTraceRecorder& other) = delete;
+    CTraceRecorder& operator=(const CTraceRecorder& other) = delete;
+    ~CTraceRecorder();
+
+    bool start(const std::string& filepath, const bool hashes);
+    void stop();
+    bool recording() const { return _recording; }
+    bool hashes() const { return _hashes; }
+    uint64_t offset(const uint64_t timestamp) const;
+    void record(const SRecord& record, const uint8_t* filename, const uint8_t* control, const uint16_t controlLen, const uint16_t status,
+                const uint64_t payloadHash);
+    static void hash(uint64_t& state, const uint8_t* data, const uint32_t size);
+
+private:
+    std::mutex        _mutex;
+    std::ofstream     _file;
+    std::atomic<bool> _recording;
+    bool              _hashes;
+    uint64_t          _startTime;
+};
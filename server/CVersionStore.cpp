@@ -0,0 +1,221 @@
+/**
+   Maman 14
+   @CVersionStore keeps previous versions of backed-up files.
+   @author Roman Koifman
+ */
+
+#include "CVersionStore.h"
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+
+/**
+   @brief current time in microseconds since epoch.
+ */
+static uint64_t nowMicros()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+
+/**
+   @brief set the retention policy. Versioning is disabled if both limits are 0.
+   @param keep number of versions to keep per file. 0 = no count limit.
+   @param maxAgeSec maximum version age in seconds. 0 = no age limit.
+ */
+void CVersionStore::configure(const uint32_t keep, const uint64_t maxAgeSec)
+{
+	_keep = keep;
+	_maxAgeSec = maxAgeSec;
+}
+
+
+/**
+   @brief the folder holding the versions of a user's file.
+ */
+std::string CVersionStore::versionsFolder(const std::string& root, const uint32_t userId, const std::string& filename) const
+{
+	std::stringstream ss;
+	ss << root << VERSIONS_FOLDER << "/" << userId << "/" << filename << "/";
+	return ss.str();
+}
+
+
+/**
+   @brief the versions exceeding the retention policy.
+   @param versions the version names of a single file.
+   @return the expired version names.
+ */
+std::set<std::string> CVersionStore::expired(const std::set<std::string>& versions) const
+{
+	const uint64_t maxAgeMicros = _maxAgeSec * 1000000;
+	const uint64_t now = nowMicros();
+	std::set<std::string> result;
+	size_t left = versions.size();
+	for (const auto& version : versions)   // ascending = oldest first.
+	{
+		uint64_t stamp = 0;
+		try
+		{
+			stamp = std::stoull(version);
+		}
+		catch (std::exception&)
+		{
+			continue;   // not a version.
+		}
+		const bool tooMany = (_keep != 0 && left > _keep);
+		const bool tooOld = (_maxAgeSec != 0 && stamp + maxAgeMicros < now);
+		if (!tooMany && !tooOld)
+			break;  // versions are ordered by time. all the rest are newer.
+		result.insert(version);
+		--left;
+	}
+	return result;
+}
+
+
+/**
+   @brief remove versions exceeding the retention policy from a versions folder. Called on write paths only.
+   @param folder the versions folder of a single file.
+   @return true if no error occurred. false otherwise.
+ */
+bool CVersionStore::prune(const std::string& folder)
+{
+	std::string folderPath(folder);
+	std::set<std::string> versions;
+	if (!_fileHandler.getFilesList(folderPath, versions))
+		return false;
+	bool success = true;
+	for (const auto& version : expired(versions))
+	{
+		if (!_fileHandler.fileRemove(folder + version))
+			success = false;
+	}
+	return success;
+}
+
+
+/**
+   @brief keep the current content of a file as its newest version, then apply the retention policy.
+          The version is a reflink of the file where supported, so it costs no data copy. Elsewhere, the file itself is
+          moved (renamed) to be the version, as it is about to be rewritten anyway: copying it would double the write I/O.
+          The caller then recreates the file.
+   @param root the backup folder.
+   @param userId the file owner.
+   @param filename the file's name.
+   @param filepath the file's current filepath.
+   @param changed the kept version's filepath will be added to this object, to be committed in durable mode.
+   @return true if the version was kept successfully. false otherwise.
+ */
+bool CVersionStore::snapshot(const std::string& root, const uint32_t userId, const std::string& filename, const std::string& filepath,
+	std::vector<std::string>& changed)
+{
+	if (!enabled())
+		return true;
+	const std::string folder = versionsFolder(root, userId, filename);
+	uint64_t stamp = nowMicros();
+	std::string versionPath;
+	do
+	{
+		std::stringstream ss;
+		ss << folder << std::setw(VERSION_DIGITS) << std::setfill('0') << stamp++;
+		versionPath = ss.str();
+	} while (_fileHandler.fileExists(versionPath));   // same microsecond.
+
+	if (!_fileHandler.fileReflink(filepath, versionPath) && !_fileHandler.fileRename(filepath, versionPath))
+		return false;
+	changed.push_back(versionPath);
+	return prune(folder);
+}
+
+
+/**
+   @brief list the versions of a file, newest first. Expired versions are skipped, but left for the next write to remove.
+   @param versions version names will be saved in this object. The name at index i is selected by i+1.
+   @return true if no error occurred. A file without versions has an empty list.
+ */
+bool CVersionStore::listVersions(const std::string& root, const uint32_t userId, const std::string& filename, std::vector<std::string>& versions)
+{
+	versions.clear();
+	if (!enabled())
+		return true;
+	const std::string folder = versionsFolder(root, userId, filename);
+	if (!_fileHandler.folderExists(folder))
+		return true;
+	std::string folderPath(folder);
+	std::set<std::string> names;
+	if (!_fileHandler.getFilesList(folderPath, names))
+		return false;
+	for (const auto& version : expired(names))
+		names.erase(version);
+	versions.assign(names.rbegin(), names.rend());
+	return true;
+}
+
+
+/**
+   @brief get the filepath of a file's version.
+   @param selector 1 is the newest previous version, 2 the one before it, etc.
+   @param filepath the version's filepath will be saved in this object.
+   @return true if the version exists. false otherwise.
+ */
+bool CVersionStore::versionPath(const std::string& root, const uint32_t userId, const std::string& filename, const uint32_t selector, std::string& filepath)
+{
+	std::vector<std::string> versions;
+	if (selector == 0 || !listVersions(root, userId, filename, versions) || selector > versions.size())
+		return false;
+	filepath = versionsFolder(root, userId, filename) + versions[selector - 1];
+	return true;
+}
+
+
+/**
+   @brief remove all versions of a file.
+   @return true if no versions are left. false otherwise.
+ */
+bool CVersionStore::removeVersions(const std::string& root, const uint32_t userId, const std::string& filename)
+{
+	if (!enabled())
+		return true;
+	return _fileHandler.folderRemove(versionsFolder(root, userId, filename));
+}
+
+
+/**
+   @brief move all versions of a renamed file to its new name. They join the destination's versions, if any,
+          in time order, then the retention policy is applied.
+   @param sourceRoot the backup folder of the file before renaming.
+   @param destinationRoot the backup folder of the renamed file.
+   @param source the file's name before renaming.
+   @param destination the file's new name.
+   @param changed a moved version's filepath will be added to this object, to be committed in durable mode.
+          Committing it flushes the destination versions folder, holding all moved versions.
+   @return true if all versions were moved. false otherwise.
+ */
+bool CVersionStore::moveVersions(const std::string& sourceRoot, const std::string& destinationRoot, const uint32_t userId,
+	const std::string& source, const std::string& destination, std::vector<std::string>& changed)
+{
+	if (!enabled())
+		return true;
+	std::string folder = versionsFolder(sourceRoot, userId, source);
+	if (!_fileHandler.folderExists(folder))
+		return true;
+	std::set<std::string> versions;
+	if (!_fileHandler.getFilesList(folder, versions))
+		return false;
+	const std::string destinationFolder = versionsFolder(destinationRoot, userId, destination);
+	for (const auto& version : versions)
+	{
+		if (!_fileHandler.fileRename(folder + version, destinationFolder + version))
+			return false;
+	}
+	if (!_fileHandler.folderRemove(folder) || !prune(destinationFolder))
+		return false;
+	std::string keptFolder(destinationFolder);
+	std::set<std::string> kept;   // a moved version may have been pruned. commit any version left.
+	if (_fileHandler.getFilesList(keptFolder, kept) && !kept.empty())
+		changed.push_back(destinationFolder + *kept.rbegin());
+	return true;
+}
@@ -0,0 +1,36 @@
+/**
+   Maman 14
+   @CVersionStore keeps previous versions of backed-up files.
+   @author Roman Koifman
+ */
+
+#pragma once
+#include "CFileHandler.h"
+#include <set>
+#include <string>
+#include <vector>
+
+class CVersionStore
+{
+#define VERSIONS_FOLDER  ".versions"   // under the backup folder. User folders are numeric, so it can't collide.
+#define VERSION_DIGITS   20            // version names are zero padded timestamps, so name order is time order.
+
+    CFileHandler _fileHandler;
+    uint32_t     _keep;        // versions to keep per file. 0 = no count limit.
+    uint64_t     _maxAgeSec;   // versions older than this are removed. 0 = no age limit.
+    std::string versionsFolder(const std::string& root, const uint32_t userId, const std::string& filename) const;
+    std::set<std::string> expired(const std::set<std::string>& versions) const;
+    bool prune(const std::string& folder);
+
+public:
+    CVersionStore() : _keep(0), _maxAgeSec(0) {}
+    void configure(const uint32_t keep, const uint64_t maxAgeSec);
+    bool enabled() const { return (_keep != 0 || _maxAgeSec != 0); }
+    bool snapshot(const std::string& root, const uint32_t userId, const std::string& filename, const std::string& filepath,
+        std::vector<std::string>& changed);
+    bool listVersions(const std::string& root, const uint32_t userId, const std::string& filename, std::vector<std::string>& versions);
+    bool versionPath(const std::string& root, const uint32_t userId, const std::string& filename, const uint32_t selector, std::string& filepath);
+    bool removeVersions(const std::string& root, const uint32_t userId, const std::string& filename);
+    bool moveVersions(const std::string& sourceRoot, const std::string& destinationRoot, const uint32_t userId,
+        const std::string& source, const std::string& destination, std::vector<std::string>& changed);
+};
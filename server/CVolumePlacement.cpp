@@ -0,0 +1,291 @@
+/**
+   Maman 14
+   @CVolumePlacement places users' files across several backup folders (one per disk).
+   @author Roman Koifman
+ */
+
+#include "CVolumePlacement.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+
+/**
+   @brief 64 bit mixing function (splitmix64 finalizer).
+ */
+static uint64_t mix(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+/**
+   @brief FNV-1a 64 hash of a string, continuing from a given state.
+ */
+static uint64_t hashString(uint64_t state, const std::string& str)
+{
+	for (const char c : str)
+	{
+		state ^= static_cast<uint8_t>(c);
+		state *= 0x100000001b3ULL;
+	}
+	return state;
+}
+
+
+/**
+   @brief set the backup folders. Folders are created if they do not exist.
+   @param roots the backup folders. At least one.
+   @param mode placement granularity.
+   @param err description error. applicable only if function returns false.
+   @return true if all folders are usable. false otherwise.
+ */
+bool CVolumePlacement::configure(const std::vector<std::string>& roots, const EMode mode, std::stringstream& err)
+{
+	std::lock_guard<std::mutex> guard(_mutex);
+	_mode = mode;
+	_roots.clear();
+	for (auto root : roots)
+	{
+		if (root.empty())
+			continue;
+		if (root.back() != '/' && root.back() != '\\')
+			root += '/';
+		if (std::find(_roots.begin(), _roots.end(), root) != _roots.end())
+			continue;
+		if (!_fileHandler.folderCreate(root))
+		{
+			err << "Backup folder " << root << " is not usable." << std::endl;
+			return false;
+		}
+		_roots.push_back(root);
+	}
+	if (_roots.empty())
+	{
+		err << "No backup folder configured." << std::endl;
+		return false;
+	}
+	_volumes.assign(_roots.size(), SVolume());
+	_refreshed = std::chrono::steady_clock::time_point();
+	refresh();
+	std::lock_guard<std::mutex> cacheGuard(_cacheMutex);
+	_locations.clear();
+	return true;
+}
+
+
+/**
+   @brief refresh roots' free space, at most once per PLACEMENT_REFRESH_SEC. _mutex should be locked.
+ */
+void CVolumePlacement::refresh()
+{
+	const auto now = std::chrono::steady_clock::now();
+	if (now - _refreshed < std::chrono::seconds(PLACEMENT_REFRESH_SEC))
+		return;
+	_refreshed = now;
+	for (size_t i = 0; i < _roots.size(); ++i)
+		(void)_fileHandler.freeSpace(_roots[i], _volumes[i].freeBytes);
+}
+
+
+/**
+   @brief rank the roots for a placement key by weighted rendezvous hashing. A root's weight is its free space,
+          reduced by its observed write latency. Changing a root's weight only moves keys from or to that root.
+   @return roots' indices, best first.
+ */
+std::vector<size_t> CVolumePlacement::rank(const uint32_t userId, const std::string& filename)
+{
+	uint64_t key = mix(0x9E3779B97F4A7C15ULL ^ userId);
+	if (_mode == PER_FILE)
+		key = hashString(key, filename);
+
+	std::vector<double> scores(_roots.size());
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		refresh();
+		for (size_t i = 0; i < _roots.size(); ++i)
+		{
+			const double freeMiB = static_cast<double>(_volumes[i].freeBytes) / 1048576.0;
+			const double weight = std::max(freeMiB, 1.0) / (1.0 + _volumes[i].latencyUsPerMiB / PLACEMENT_LATENCY_REF_US);
+			const uint64_t h = mix(hashString(key, _roots[i]));
+			const double u = (static_cast<double>(h >> 11) + 0.5) / 9007199254740992.0;   // uniform in (0, 1).
+			scores[i] = weight / -std::log(u);
+		}
+	}
+	std::vector<size_t> order(_roots.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&scores](const size_t a, const size_t b) { return scores[a] > scores[b]; });
+	return order;
+}
+
+
+/**
+   @brief the location cache key of a file: its user in PER_USER mode, the file itself in PER_FILE mode.
+ */
+std::string CVolumePlacement::cacheKey(const uint32_t userId, const std::string& filename) const
+{
+	std::stringstream ss;
+	ss << userId;
+	if (_mode == PER_FILE)
+		ss << "/" << filename;
+	return ss.str();
+}
+
+
+/**
+   @brief look a file's root up in the location cache.
+   @param index the cached root's index will be saved in this object.
+   @return true if cached. false otherwise.
+ */
+bool CVolumePlacement::cached(const uint32_t userId, const std::string& filename, size_t& index)
+{
+	const std::string key = cacheKey(userId, filename);
+	std::lock_guard<std::mutex> guard(_cacheMutex);
+	const auto location = _locations.find(key);
+	if (location == _locations.end())
+		return false;
+	index = location->second;
+	return true;
+}
+
+
+/**
+   @brief cache the root of a file which was just created, copied or renamed there.
+          In PER_USER mode, the user's first known root is kept.
+ */
+void CVolumePlacement::remember(const uint32_t userId, const std::string& filename, const std::string& root)
+{
+	const auto found = std::find(_roots.begin(), _roots.end(), root);
+	if (found == _roots.end())
+		return;
+	const std::string key = cacheKey(userId, filename);
+	std::lock_guard<std::mutex> guard(_cacheMutex);
+	if (_locations.size() >= PLACEMENT_CACHE_MAX)
+		_locations.clear();
+	const size_t index = static_cast<size_t>(found - _roots.begin());
+	if (_mode == PER_FILE)
+		_locations[key] = index;
+	else
+		(void)_locations.emplace(key, index);
+}
+
+
+/**
+   @brief drop a removed or renamed file from the location cache. In PER_USER mode, the user's root stays cached.
+ */
+void CVolumePlacement::forget(const uint32_t userId, const std::string& filename)
+{
+	if (_mode != PER_FILE)
+		return;
+	const std::string key = cacheKey(userId, filename);
+	std::lock_guard<std::mutex> guard(_cacheMutex);
+	_locations.erase(key);
+}
+
+
+/**
+   @brief choose the root to write a file to. An existing file is overwritten where it is, so its versions stay
+          with it. In PER_USER mode, a new file joins the user's existing files.
+          A cached location is used as is. Roots are probed on a cache miss only.
+   @return the root.
+ */
+std::string CVolumePlacement::place(const uint32_t userId, const std::string& filename)
+{
+	size_t index = 0;
+	if (cached(userId, filename, index))
+		return _roots[index];
+	const auto order = rank(userId, filename);
+	for (const auto i : order)
+	{
+		if (_fileHandler.fileExists(filePath(_roots[i], userId, filename)))
+			return _roots[i];
+	}
+	if (_mode == PER_USER)
+	{
+		for (const auto i : order)
+		{
+			if (_fileHandler.folderExists(userFolder(_roots[i], userId)))
+				return _roots[i];
+		}
+	}
+	return _roots[order.front()];
+}
+
+
+/**
+   @brief find the root holding an existing file. A file cached in PER_FILE mode is found without probing.
+          In PER_USER mode, the user's cached root is probed first. Otherwise, the root ranked first is probed first.
+   @param root the root will be saved in this object.
+   @return true if found. false otherwise.
+ */
+bool CVolumePlacement::locate(const uint32_t userId, const std::string& filename, std::string& root)
+{
+	size_t index = 0;
+	const bool hit = cached(userId, filename, index);
+	if (hit && (_mode == PER_FILE || _fileHandler.fileExists(filePath(_roots[index], userId, filename))))
+	{
+		root = _roots[index];
+		return true;
+	}
+	for (const auto i : rank(userId, filename))
+	{
+		if (hit && i == index)
+			continue;   // probed above.
+		if (_fileHandler.fileExists(filePath(_roots[i], userId, filename)))
+		{
+			root = _roots[i];
+			remember(userId, filename, root);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/**
+   @brief a user's folder on a given root.
+ */
+std::string CVolumePlacement::userFolder(const std::string& root, const uint32_t userId) const
+{
+	std::stringstream ss;
+	ss << root << userId << "/";
+	return ss.str();
+}
+
+
+/**
+   @brief a user's file path on a given root.
+ */
+std::string CVolumePlacement::filePath(const std::string& root, const uint32_t userId, const std::string& filename) const
+{
+	return userFolder(root, userId) + filename;
+}
+
+
+/**
+   @brief account an observed write to a root, lowering the weight of slow roots.
+   @param root the root written to.
+   @param bytes bytes written.
+   @param micros time spent writing.
+ */
+void CVolumePlacement::reportWrite(const std::string& root, const uint64_t bytes, const uint64_t micros)
+{
+	if (bytes == 0)
+		return;
+	const double sample = static_cast<double>(micros) * 1048576.0 / static_cast<double>(bytes);
+	std::lock_guard<std::mutex> guard(_mutex);
+	for (size_t i = 0; i < _roots.size(); ++i)
+	{
+		if (_roots[i] != root)
+			continue;
+		auto& latency = _volumes[i].latencyUsPerMiB;
+		latency = (latency == 0) ? sample : (1.0 - PLACEMENT_LATENCY_EWMA) * latency + PLACEMENT_LATENCY_EWMA * sample;
+		if (_volumes[i].freeBytes > bytes)
+			_volumes[i].freeBytes -= bytes;   // until next refresh.
+		return;
+	}
+}
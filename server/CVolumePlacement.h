@@ -0,0 +1,62 @@
+/**
+   Maman 14
+   @CVolumePlacement places users' files across several backup folders (one per disk).
+   @author Roman Koifman
+ */
+
+#pragma once
+#include "CFileHandler.h"
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class CVolumePlacement
+{
+public:
+#define PLACEMENT_REFRESH_SEC    10        // free space refresh interval.
+#define PLACEMENT_LATENCY_REF_US 10000.0   // write latency per MiB at which a root's weight is halved.
+#define PLACEMENT_LATENCY_EWMA   0.1       // weight of a new write latency sample.
+#define PLACEMENT_CACHE_MAX      1000000   // cached locations. The cache is cleared when full.
+
+    enum EMode
+    {
+        PER_USER,   // all files of a user are placed on the same root.
+        PER_FILE    // each file is placed independently.
+    };
+
+    CVolumePlacement() : _mode(PER_USER) {}
+    bool configure(const std::vector<std::string>& roots, const EMode mode, std::stringstream& err);
+    const std::vector<std::string>& roots() const { return _roots; }
+    std::string place(const uint32_t userId, const std::string& filename);
+    bool locate(const uint32_t userId, const std::string& filename, std::string& root);
+    std::string userFolder(const std::string& root, const uint32_t userId) const;
+    std::string filePath(const std::string& root, const uint32_t userId, const std::string& filename) const;
+    void reportWrite(const std::string& root, const uint64_t bytes, const uint64_t micros);
+    void remember(const uint32_t userId, const std::string& filename, const std::string& root);
+    void forget(const uint32_t userId, const std::string& filename);
+
+private:
+    struct SVolume
+    {
+        uint64_t freeBytes;
+        double   latencyUsPerMiB;   // EWMA of observed write latency.
+        SVolume() : freeBytes(0), latencyUsPerMiB(0) {}
+    };
+
+    CFileHandler             _fileHandler;
+    EMode                    _mode;
+    std::vector<std::string> _roots;
+    std::mutex               _mutex;      // guards _volumes & _refreshed.
+    std::vector<SVolume>     _volumes;
+    std::chrono::steady_clock::time_point _refreshed;
+    std::mutex               _cacheMutex; // guards _locations.
+    std::unordered_map<std::string, size_t> _locations;   // placement key to root index: the user's root in PER_USER mode,
+                                                          // the file's root in PER_FILE mode. Spares probing every root.
+    std::vector<size_t> rank(const uint32_t userId, const std::string& filename);
+    void refresh();
+    std::string cacheKey(const uint32_t userId, const std::string& filename) const;
+    bool cached(const uint32_t userId, const std::string& filename, size_t& index);
+};
@@ -0,0 +1,37 @@
+/**
+   Maman 14
+   @Errors reasons a request failed. Reported by the storage backends, logged by CLogger.
+   @author Roman Koifman
+ */
+
+#pragma once
+#include <cstdint>
+
+enum EError : uint16_t
+{
+    ERROR_NONE = 0,
+    ERROR_EXCEPTION,               // exception thrown while handling the request.
+    ERROR_RECEIVE,                 // failed to receive request from socket.
+    ERROR_SEND,                    // failed to send response on socket.
+    ERROR_INVALID_USER,            // invalid user id.
+    ERROR_NO_FILES,                // user has no files.
+    ERROR_INVALID_FILENAME,        // invalid filename.
+    ERROR_NOT_EXIST,               // file doesn't exist.
+    ERROR_INVALID_OP,              // invalid request code.
+    ERROR_INVALID_SELECTOR,        // invalid version selector / FILE_DIR flags.
+    ERROR_VERSION_NOT_EXIST,       // requested version doesn't exist.
+    ERROR_VERSION_KEEP,            // failed to keep a version of an overwritten file.
+    ERROR_VERSIONS_LIST,           // failed to list versions.
+    ERROR_FILE_OPEN,               // failed to open file.
+    ERROR_FILE_WRITE,              // failed to write to file.
+    ERROR_FILE_READ,               // failed to read from file.
+    ERROR_FILE_EMPTY,              // file to restore is empty.
+    ERROR_FILE_COMMIT,             // failed to commit file to stable storage.
+    ERROR_FILE_REMOVE,             // failed to remove file.
+    ERROR_FILE_COPY,               // failed to copy file.
+    ERROR_FILE_RENAME,             // failed to rename file.
+    ERROR_FILES_LIST,              // failed to list files.
+    ERROR_PAYLOAD_RECEIVE,         // failed to receive payload from socket.
+    ERROR_PAYLOAD_SEND,            // failed to send payload on socket.
+    ERROR_COUNT
+};
@@ -0,0 +1,31 @@
+/**
+   Maman 14
+   @Probes static user-level tracepoints (USDT) at request phase boundaries, provider "backupsvr".
+           Probes compile to a single nop each, so they cost nothing until perf / bpftrace attach, e.g.
+           bpftrace -e 'usdt:./server:backupsvr:lock__acquired { @wait = hist(arg1); }'
+           Probes are compiled out where <sys/sdt.h> is unavailable (apt: systemtap-sdt-dev), or with NO_PROBES defined.
+   @author Roman Koifman
+ */
+
+#pragma once
+
+#if defined(__has_include) && !defined(NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PROBES_ENABLED
+#endif
+#endif
+
+#ifdef PROBES_ENABLED
+#define PROBE0(name)                DTRACE_PROBE(backupsvr, name)
+#define PROBE1(name, a)             DTRACE_PROBE1(backupsvr, name, a)
+#define PROBE2(name, a, b)          DTRACE_PROBE2(backupsvr, name, a, b)
+#define PROBE3(name, a, b, c)       DTRACE_PROBE3(backupsvr, name, a, b, c)
+#define PROBE4(name, a, b, c, d)    DTRACE_PROBE4(backupsvr, name, a, b, c, d)
+#else  // arguments are not evaluated, yet count as used.
+#define PROBE0(name)                do {} while (0)
+#define PROBE1(name, a)             do { (void)sizeof(a); } while (0)
+#define PROBE2(name, a, b)          do { (void)sizeof(a); (void)sizeof(b); } while (0)
+#define PROBE3(name, a, b, c)       do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while (0)
+#define PROBE4(name, a, b, c, d)    do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); (void)sizeof(d); } while (0)
+#endif
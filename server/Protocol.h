@@ -0,0 +1,108 @@
+/**
+   Maman 14
+   @Protocol wire definitions of requests & responses. Shared by the server and the C++ client library.
+   @author Roman Koifman
+ */
+
+#pragma once
+#include <cstdint>
+
+#define PACKET_SIZE     1024  // Requests & responses are sent in packets of this size.
+#define SERVER_VERSION  1     // Shouldn't be verified. Requirement from forum.
+#define CLIENT_VERSION_PERSISTENT  2  // Clients of this version or above keep the connection open for further requests.
+#define CLIENT_VERSION_SPARSE      3  // Clients of this version or above accept sparse restores (SUCCESS_RESTORE_SPARSE).
+
+struct SPayload  // Common for Request & Response.
+{
+    uint32_t size;     // payload size
+    uint8_t* payload;
+    SPayload() : size(0), payload(nullptr) {}
+};
+
+
+struct SRequest
+{
+#pragma pack(push, 1)      // SRequestHeader is copied to buffer to send on socket. Hence, should be aligned to 1.
+    struct SRequestHeader
+    {
+        uint32_t userId;     // User ID
+        uint8_t  version;    // Client Version
+        uint8_t  op;         // Request Code
+        SRequestHeader() : userId(0), version(0), op(0) {}
+    };
+#pragma pack(pop)
+
+    enum EOp
+    {
+        FILE_BACKUP = 100,  // Save file backup. All fields should be valid.
+        FILE_RESTORE = 200,  // Restore a file. Optional 4 bytes payload selects a previous version (1 = newest).
+        FILE_REMOVE = 201,  // Delete a file and its versions. size, payload unused.
+        FILE_DIR = 202,  // List all client's files. name_len, filename unused. Optional 4 bytes payload != 0 lists versions too.
+        FILE_COPY = 203,  // Copy a file within the server. payload is the destination filename. Overwritten destination is kept as a version.
+        FILE_RENAME = 204,  // Rename a file within the server. payload is the destination filename. Source's versions are removed.
+        FILE_RESTORE_ALL = 205   // Restore all client's files as one archive stream. Optional filename is a name prefix filter. payload unused.
+    };
+
+    SRequestHeader header;  // request header
+    uint16_t nameLen;       // FileName length
+    uint8_t* filename;      // FileName
+    SPayload payload;
+    SRequest() : nameLen(0), filename(nullptr) {}
+    uint32_t sizeWithoutPayload() const { return (sizeof(header) + sizeof(nameLen) + nameLen + sizeof(payload.size)); }
+};
+
+
+struct SResponse
+{
+    enum EStatus
+    {
+        SUCCESS_RESTORE = 210,   // File was found and restored. all fields are valid.
+        SUCCESS_DIR = 211,   // Files listing returned successfully. all fields are valid.
+        SUCCESS_BACKUP_DELETE = 212,   // File was successfully backed up, deleted, copied or renamed. size, payload are invalid. [From forum].
+        SUCCESS_RESTORE_SPARSE = 213,  // File restored without its holes. payload is an SExtentMap, its extents, then their data.
+        SUCCESS_RESTORE_ALL = 214,     // Archive stream follows. size is the number of files. See SArchiveEntry.
+        ERROR_NOT_EXIST = 1001,  // File doesn't exist. size, payload are invalid.
+        ERROR_NO_FILES = 1002,  // Client has no files. Only status & version are valid.
+        ERROR_GENERIC = 1003   // Generic server error. Only status & version are valid.
+    };
+
+    const uint8_t version;    // Server Version
+    uint16_t status;          // Request status
+    uint16_t nameLen;         // FileName length
+    uint8_t* filename;        // FileName
+    SPayload payload;
+    SResponse() : version(SERVER_VERSION), status(0), nameLen(0), filename(nullptr) {}
+    uint32_t sizeWithoutPayload() const { return (sizeof(version) + sizeof(status) + sizeof(nameLen) + nameLen + sizeof(payload.size)); }
+};
+
+
+#pragma pack(push, 1)
+/**
+   SUCCESS_RESTORE_SPARSE payload prefix. Followed by `count` SExtent, then the extents' data in order.
+   The restored file is `size` bytes long. Bytes outside the extents are zero.
+ */
+struct SExtentMap
+{
+    uint32_t size;     // logical file size.
+    uint32_t count;    // number of extents.
+};
+
+struct SExtent
+{
+    uint32_t offset;
+    uint32_t length;
+};
+#pragma pack(pop)
+
+
+#pragma pack(push, 1)
+/**
+   SUCCESS_RESTORE_ALL stream entry. Followed by nameLen bytes of filename, then the file's size (uint32_t) & data.
+   Entries are packed back to back from the response's payload position on. An entry of nameLen 0 ends the stream.
+   The last packet is zero padded.
+ */
+struct SArchiveEntry
+{
+    uint16_t nameLen;
+};
+#pragma pack(pop)
@@ -17,35 +17,21 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "CServerLogic.h"
+#include <csignal>
+#include <cstdlib>
 #include <iostream>
 #include <thread>
 #include <boost/asio.hpp>
 using boost::asio::ip::tcp;
 
-/**
-    If DEBUG_RESOLVE set to 1, resolve errors will be printed to std::out.
-    It's set to 0 because server shouldn't print errors for each thread, at least without a lock.
-    Locking the out stream will make the server to answer threads more slowly. Hence default value is 0.
-    This explanation is for the Maman14 checkers to show that I thought of it, but printing within server was not required.
- */
-#define DEBUG_RESOLVE 0
-
 // private globals
 static CServerLogic serverLogic;
-static const uint16_t port = 8080;
 
 void handleRequest(tcp::socket sock)
 {
     try
     {
-        std::stringstream err;
-        const bool success = serverLogic.handleSocketFromThread(sock, err);
-#if DEBUG_RESOLVE == 1     // See comment above. 
-        if (!success)
-        {
-            std::cout << err.str() << std::endl;
-        }
-#endif
+        (void)serverLogic.handleSocketFromThread(sock);   // requests are logged asynchronously by CServerLogic.
     }
     catch (std::exception& e)
     {
@@ -58,11 +44,43 @@ int main(int argc, char* argv[])
 {
 	try
     {
+        CServerConfig config;
+        std::stringstream err;
+        if (!config.parse(argc, argv, err))
+        {
+            std::cerr << err.str() << CServerConfig::usage(argv[0]);
+            return 1;
+        }
+        if (!serverLogic.initialize(config, err))
+        {
+            std::cerr << err.str();
+            return 1;
+        }
+
+        // On SIGINT / SIGTERM, flush the log & trace before exiting. Handling threads are not waited for.
+        boost::asio::io_context signalContext;
+        boost::asio::signal_set signals(signalContext, SIGINT, SIGTERM);
+        signals.async_wait([](const boost::system::error_code& error, int)
+        {
+            if (error)
+                return;
+            serverLogic.shutdown();
+            std::_Exit(0);
+        });
+        std::thread signalThread([&signalContext]() { signalContext.run(); });
+        signalThread.detach();
+
         boost::asio::io_context io_context;
-        tcp::acceptor accptr(io_context, tcp::endpoint(tcp::v4(), port));
+        tcp::acceptor accptr(io_context, tcp::endpoint(tcp::v4(), config.port));
         for (;;)
         {
-            std::thread(handleRequest, accptr.accept()).detach();
+            boost::system::error_code error;
+            tcp::socket sock = accptr.accept(error);
+            if (error == boost::asio::error::interrupted)
+                continue;  // signal delivered to this thread.
+            if (error)
+                throw boost::system::system_error(error, "accept");
+            std::thread(handleRequest, std::move(sock)).detach();
         }
     }
     catch(std::exception& e)